@@ -1,12 +1,113 @@
 import { NextRequest, NextResponse } from 'next/server';
-import { writeFile, unlink } from 'fs/promises';
 import { join } from 'path';
-import { exec } from 'child_process';
-import { promisify } from 'util';
-import os from 'os';
+import { spawn, ChildProcessWithoutNullStreams } from 'child_process';
+import { createHash, randomUUID } from 'crypto';
 import fs from 'fs';
+import { decodeMsgPack, MsgPackValue } from '@/app/utils/msgpack';
 
-const execAsync = promisify(exec);
+// A single resident `calibrate_camera --server` process keeps every client's
+// views in memory, keyed by session (protocol in cpp/calibrate_camera.cpp).
+// Each request only sends the views that changed since the session's last
+// request, and the recalibration warm-starts from the previous solution.
+// Commands are answered in order, one MessagePack record each (a little
+// endian uint32 size, then the record), so pending commands form a FIFO queue.
+type PendingCommand = { resolve: (record: Buffer) => void; reject: (err: Error) => void };
+
+class CalibrateWorker {
+  private proc: ChildProcessWithoutNullStreams;
+  private pending: PendingCommand[] = [];
+  private buffer = Buffer.alloc(0);
+
+  constructor(binaryPath: string) {
+    this.proc = spawn(binaryPath, ['--server', '--output=msgpack']);
+    this.proc.stdout.on('data', (chunk: Buffer) => {
+      this.buffer = this.buffer.length ? Buffer.concat([this.buffer, chunk]) : chunk;
+      while (this.buffer.length >= 4) {
+        const end = 4 + this.buffer.readUInt32LE(0);
+        if (this.buffer.length < end) break;
+        const record = this.buffer.subarray(4, end);
+        this.buffer = this.buffer.subarray(end);
+        const command = this.pending.shift();
+        if (command) command.resolve(record);
+      }
+    });
+    this.proc.stderr.on('data', (chunk) => console.error('[calibrate_camera]', chunk.toString()));
+    this.proc.stdin.on('error', (err) => this.fail(err));
+    this.proc.on('error', (err) => this.fail(err));
+    this.proc.on('exit', (code) => this.fail(new Error(`calibrate_camera exited with code ${code}`)));
+  }
+
+  // Commands are written synchronously, so the commands of one request are
+  // never interleaved with another request's.
+  send(command: string): Promise<{ [key: string]: MsgPackValue }> {
+    return new Promise<Buffer>((resolve, reject) => {
+      this.pending.push({ resolve, reject });
+      this.proc.stdin.write(command + '\n');
+    }).then((record) => decodeMsgPack(record) as { [key: string]: MsgPackValue });
+  }
+
+  private fail(err: Error) {
+    if (worker === this) {
+      worker = null;
+      // The sessions lived in the process.
+      sessions.clear();
+    }
+    const commands = this.pending;
+    this.pending = [];
+    for (const command of commands) command.reject(err);
+  }
+}
+
+// What the server holds for a session: its image size and view ids, in the
+// server's order. Ids are hashes of the view's points.
+type SessionState = { width: number; height: number; views: string[]; lastUsed: number };
+
+const SESSION_IDLE_MS = 30 * 60 * 1000;
+let worker: CalibrateWorker | null = null;
+const sessions = new Map<string, SessionState>();
+
+// Everything sent to the server is formatted from checked numbers and
+// tokens: the process is shared by all clients, so a stray newline in a
+// request value would inject commands into other sessions and shift the
+// queue of pending replies.
+const SESSION_ID = /^[A-Za-z0-9_-]{1,64}$/;
+
+function isPointList(points: unknown, withZ: boolean): points is { x: number; y: number; z?: number }[] {
+  return Array.isArray(points) && points.length > 0 && points.every((pt) =>
+    pt !== null && typeof pt === 'object' &&
+    Number.isFinite(pt.x) && Number.isFinite(pt.y) &&
+    (!withZ || pt.z === undefined || Number.isFinite(pt.z)));
+}
+
+function isImageSize(size: any): size is { width: number; height: number } {
+  return size !== null && typeof size === 'object' &&
+    Number.isInteger(size.width) && size.width > 0 && Number.isInteger(size.height) && size.height > 0;
+}
+
+function viewId(imgPts: any[], objPts: any[]) {
+  const hash = createHash('sha1');
+  for (const pt of imgPts) hash.update(`${pt.x},${pt.y};`);
+  for (const pt of objPts) hash.update(`${pt.x},${pt.y},${pt.z ?? 0};`);
+  return hash.digest('hex').slice(0, 20);
+}
+
+// Points must have passed isPointList.
+function addCommand(session: string, view: string, imgPts: any[], objPts: any[]) {
+  const parts = [`add ${session} ${view} ${imgPts.length}`];
+  for (const pt of imgPts) parts.push(`${Number(pt.x).toString()} ${Number(pt.y).toString()}`);
+  for (const pt of objPts) {
+    parts.push(`${Number(pt.x).toString()} ${Number(pt.y).toString()} ${Number(pt.z ?? 0).toString()}`);
+  }
+  return parts.join(' ');
+}
+
+// Put per-view arrays of the result back in request order.
+function reorder(result: { [key: string]: MsgPackValue }, order: number[]) {
+  for (const key of ['rvecs', 'tvecs', 'perViewErrors', 'residuals']) {
+    const values = result[key];
+    if (Array.isArray(values)) result[key] = order.map((index) => values[index]);
+  }
+}
 
 export async function POST(request: NextRequest) {
   try {
@@ -16,95 +117,117 @@ export async function POST(request: NextRequest) {
     if (!allImagePoints || !objPoints || !imageSize) {
       return NextResponse.json({ error: 'Missing parameters' }, { status: 400 });
     }
+    if (!Array.isArray(allImagePoints) || !Array.isArray(objPoints) || !isImageSize(imageSize)) {
+      return NextResponse.json({ error: 'Invalid parameters' }, { status: 400 });
+    }
+    if (body.sessionId !== undefined && (typeof body.sessionId !== 'string' || !SESSION_ID.test(body.sessionId))) {
+      return NextResponse.json({ error: 'Invalid sessionId' }, { status: 400 });
+    }
+
+    const views: { id: string; imgPts: any[]; objPts: any[] }[] = [];
+    const seen = new Map<string, number>();
 
-    // Serialize to custom text format for C++
-    let content = `${imageSize.width} ${imageSize.height} ${allImagePoints.length}\n`;
-    
     for (let i = 0; i < allImagePoints.length; i++) {
         const imgPts = allImagePoints[i];
-        const objPts = objPoints[i]; // Assuming objPoints is per-image or same for all?
-        // JS worker often passes same objPoints for all, or per image.
-        // Let's assume input matches structure.
-        
+
         // If objPoints is a single array (shared pattern), repeat it.
         // But usually in calibration logic, we pass array of arrays.
         // Let's check AprilTagContext usage.
         // It passes `allImagePoints` (array of arrays) and `objPoints` (array of arrays).
-        
+
         const currentObjPts = Array.isArray(objPoints[0]) ? objPoints[i] : objPoints;
-        
+
+        if (!isPointList(imgPts, false) || !isPointList(currentObjPts, true)) {
+            return NextResponse.json({
+                error: `Invalid points for image ${i}`,
+                details: 'Every coordinate must be a finite number'
+            }, { status: 400 });
+        }
+
         if (imgPts.length !== currentObjPts.length) {
-            return NextResponse.json({ 
+            return NextResponse.json({
                 error: `Mismatch between image points and object points for image ${i}`,
                 details: `Image points: ${imgPts.length}, Object points: ${currentObjPts.length}`
             }, { status: 400 });
         }
 
-        content += `${imgPts.length}\n`;
-        for (const pt of imgPts) {
-            content += `${pt.x} ${pt.y}\n`;
-        }
-        for (const pt of currentObjPts) {
-            content += `${pt.x} ${pt.y} ${pt.z}\n`;
-        }
+        // Identical views are legal; number repeats so ids stay unique.
+        let id = viewId(imgPts, currentObjPts);
+        const repeats = seen.get(id) ?? 0;
+        seen.set(id, repeats + 1);
+        if (repeats > 0) id += `-${repeats}`;
+        views.push({ id, imgPts, objPts: currentObjPts });
     }
 
-    // Save to temp file
-    const tempDir = os.tmpdir();
-    const tempFilePath = join(tempDir, `calib_data_${Date.now()}_${Math.random()}.txt`);
-    await writeFile(tempFilePath, content);
-
     // Path to C++ executable
     const projectRoot = process.cwd();
     const binaryPath = join(projectRoot, 'cpp', 'build', 'calibrate_camera');
 
     if (!fs.existsSync(binaryPath)) {
-       await unlink(tempFilePath);
-       return NextResponse.json({ 
+       return NextResponse.json({
          error: 'C++ binary not found.',
-         instruction: 'Run: cd cpp && mkdir build && cd build && cmake .. && make' 
+         instruction: 'Run: cd cpp && mkdir build && cd build && cmake .. && make'
        }, { status: 500 });
     }
 
     try {
-      console.log(`[API] Executing: "${binaryPath}" "${tempFilePath}"`);
-      const { stdout, stderr } = await execAsync(`"${binaryPath}" "${tempFilePath}"`);
-      
-      console.log('[API] stdout:', stdout);
-      if (stderr) console.error('[API] stderr:', stderr);
-
-      await unlink(tempFilePath);
-
-      try {
-          // Robust JSON parsing
-          const jsonStart = stdout.indexOf('{');
-          const jsonEnd = stdout.lastIndexOf('}');
-          if (jsonStart !== -1 && jsonEnd !== -1) {
-             const jsonStr = stdout.substring(jsonStart, jsonEnd + 1);
-             const result = JSON.parse(jsonStr);
-             return NextResponse.json(result);
-          }
-          // If C++ crashed without JSON, show stdout
-          throw new Error('No JSON output found in stdout');
-      } catch (e: any) {
-          console.error('Failed to parse C++ output:', stdout);
-          // Return the raw stdout as error details so we can see what happened
-          return NextResponse.json({ 
-              error: 'Invalid output from C++ backend', 
-              details: stdout.substring(0, 500) + (stdout.length > 500 ? '...' : ''), // Limit length
-              fullStdout: stdout,
-              parseError: e.message 
-          }, { status: 500 });
+      if (!worker) worker = new CalibrateWorker(binaryPath);
+      const server = worker;
+
+      // Drop sessions whose clients went away.
+      const now = Date.now();
+      for (const [id, state] of sessions) {
+        if (now - state.lastUsed > SESSION_IDLE_MS) {
+          sessions.delete(id);
+          server.send(`close ${id}`).catch(() => {});
+        }
+      }
+
+      // Without a session id from the client the session lasts one request.
+      const clientSession = body.sessionId !== undefined;
+      const sessionId: string = clientSession ? body.sessionId : randomUUID();
+      let state = sessions.get(sessionId);
+      const replies: Promise<{ [key: string]: MsgPackValue }>[] = [];
+
+      if (!state || state.width !== imageSize.width || state.height !== imageSize.height) {
+        state = { width: imageSize.width, height: imageSize.height, views: [], lastUsed: now };
+        replies.push(server.send(`open ${sessionId} ${imageSize.width} ${imageSize.height}`));
+      }
+      state.lastUsed = now;
+      if (clientSession) sessions.set(sessionId, state);
+
+      // Only the difference to what the server already holds is sent.
+      const wanted = new Set(views.map((view) => view.id));
+      for (const id of state.views) {
+        if (!wanted.has(id)) replies.push(server.send(`remove ${sessionId} ${id}`));
+      }
+      state.views = state.views.filter((id) => wanted.has(id));
+      const held = new Set(state.views);
+      for (const view of views) {
+        if (held.has(view.id)) continue;
+        replies.push(server.send(addCommand(sessionId, view.id, view.imgPts, view.objPts)));
+        state.views.push(view.id);
       }
+      const calibration = server.send(`calibrate ${sessionId}`);
+      if (!clientSession) server.send(`close ${sessionId}`).catch(() => {});
+
+      const [changes, result] = await Promise.all([Promise.all(replies), calibration]);
+      const failed = changes.find((reply) => reply.success !== true);
+      if (failed) {
+        // The server's view of the session is unknown now; start over next time.
+        sessions.delete(sessionId);
+        return NextResponse.json({ error: 'Backend execution failed', details: failed.error }, { status: 500 });
+      }
+
+      const position = new Map(state.views.map((id, index) => [id, index] as [string, number]));
+      reorder(result, views.map((view) => position.get(view.id)!));
+      return NextResponse.json(result);
 
     } catch (execError: any) {
-      await unlink(tempFilePath).catch(() => {});
       console.error('Execution error:', execError);
-      return NextResponse.json({ 
-          error: 'Backend execution failed', 
-          details: execError.message,
-          stderr: execError.stderr,
-          stdout: execError.stdout
+      return NextResponse.json({
+          error: 'Backend execution failed',
+          details: execError.message
       }, { status: 500 });
     }
 
@@ -112,4 +235,4 @@ export async function POST(request: NextRequest) {
     console.error('API Error:', error);
     return NextResponse.json({ error: 'Internal Server Error', details: error.message }, { status: 500 });
   }
-}
\ No newline at end of file
+}
@@ -1,12 +1,86 @@
 import { NextRequest, NextResponse } from 'next/server';
-import { writeFile, unlink } from 'fs/promises';
 import { join } from 'path';
-import { exec } from 'child_process';
-import { promisify } from 'util';
-import os from 'os';
+import { spawn, ChildProcessWithoutNullStreams } from 'child_process';
 import fs from 'fs';
+import { decodeMsgPack, decodePoints, MsgPackValue } from '@/app/utils/msgpack';
 
-const execAsync = promisify(exec);
+// A single resident `detect_corners --server` process answers all uploads.
+// Each job is a header line followed by the encoded image bytes on its stdin,
+// so uploads never touch the disk. It answers each job with one MessagePack
+// record on stdout (a little endian uint32 size, then the record), in the
+// same order, so pending jobs form a FIFO queue.
+type PendingJob = { resolve: (record: Buffer) => void; reject: (err: Error) => void };
+
+class DetectWorker {
+  private proc: ChildProcessWithoutNullStreams;
+  private pending: PendingJob[] = [];
+  private buffer = Buffer.alloc(0);
+
+  constructor(binaryPath: string) {
+    this.proc = spawn(binaryPath, ['--server', '--output=msgpack']);
+    this.proc.stdout.on('data', (chunk: Buffer) => {
+      this.buffer = this.buffer.length ? Buffer.concat([this.buffer, chunk]) : chunk;
+      while (this.buffer.length >= 4) {
+        const end = 4 + this.buffer.readUInt32LE(0);
+        if (this.buffer.length < end) break;
+        const record = this.buffer.subarray(4, end);
+        this.buffer = this.buffer.subarray(end);
+        const job = this.pending.shift();
+        if (job) job.resolve(record);
+      }
+    });
+    this.proc.stderr.on('data', (chunk) => console.error('[detect_corners]', chunk.toString()));
+    this.proc.stdin.on('error', (err) => this.fail(err));
+    this.proc.on('error', (err) => this.fail(err));
+    this.proc.on('exit', (code) => this.fail(new Error(`detect_corners exited with code ${code}`)));
+  }
+
+  detect(image: Buffer, rows: number, cols: number): Promise<Buffer> {
+    return new Promise((resolve, reject) => {
+      this.pending.push({ resolve, reject });
+      this.proc.stdin.write(`${rows} ${cols} --bytes=${image.length} -\n`);
+      this.proc.stdin.write(image);
+    });
+  }
+
+  private fail(err: Error) {
+    if (worker === this) worker = null;
+    const jobs = this.pending;
+    this.pending = [];
+    for (const job of jobs) job.reject(err);
+  }
+}
+
+let worker: DetectWorker | null = null;
+
+// When the optional calibcore.node addon has been built (cmake
+// -DBUILD_NODE_ADDON=ON), detection runs in-process on the libuv thread pool
+// instead; corners then come back as a Float32Array of x, y pairs.
+type NativeDetector = {
+  detect(image: Buffer, rows: number, cols: number): Promise<{ [key: string]: any }>;
+};
+let nativeDetector: NativeDetector | null | undefined;
+
+function loadNativeDetector(addonPath: string): NativeDetector | null {
+  if (nativeDetector !== undefined) return nativeDetector;
+  nativeDetector = null;
+  if (fs.existsSync(addonPath)) {
+    try {
+      const addon = { exports: {} as NativeDetector };
+      process.dlopen(addon, addonPath);
+      nativeDetector = addon.exports;
+    } catch (e) {
+      console.error('Failed to load calibcore.node, using detect_corners instead:', e);
+    }
+  }
+  return nativeDetector;
+}
+
+function toPoints(corners: Float32Array) {
+  const points = [];
+  for (let i = 0; i + 1 < corners.length; i += 2) points.push({ x: corners[i], y: corners[i + 1] });
+  return points;
+}
 
 export async function POST(request: NextRequest) {
   try {
@@ -22,18 +96,30 @@ export async function POST(request: NextRequest) {
     const bytes = await file.arrayBuffer();
     const buffer = Buffer.from(bytes);
 
-    // Save to temp file
-    const tempDir = os.tmpdir();
-    const tempFilePath = join(tempDir, `calib_${Date.now()}_${Math.random()}.jpg`);
-    await writeFile(tempFilePath, buffer);
+    if (buffer.length === 0) {
+      return NextResponse.json({ error: 'Empty image' }, { status: 400 });
+    }
 
     // Path to C++ executable
     // Assuming the user compiles it to <project_root>/cpp/build/detect_corners
     const projectRoot = process.cwd();
     const binaryPath = join(projectRoot, 'cpp', 'build', 'detect_corners');
+    const rowCount = parseInt(String(rows), 10) || 0;
+    const colCount = parseInt(String(cols), 10) || 0;
+
+    const native = loadNativeDetector(join(projectRoot, 'cpp', 'build', 'calibcore.node'));
+    if (native) {
+      try {
+        const result = await native.detect(buffer, rowCount, colCount);
+        if (result.corners instanceof Float32Array) result.corners = toPoints(result.corners);
+        return NextResponse.json(result);
+      } catch (nativeError: any) {
+        console.error('Native detection error:', nativeError);
+        return NextResponse.json({ success: false, error: nativeError.message }, { status: 500 });
+      }
+    }
 
     if (!fs.existsSync(binaryPath)) {
-       await unlink(tempFilePath);
        return NextResponse.json({ 
          error: 'C++ binary not found. Please compile the backend.',
          instruction: 'Run: cd cpp && mkdir build && cd build && cmake .. && make' 
@@ -41,30 +127,21 @@ export async function POST(request: NextRequest) {
     }
 
     try {
-      const { stdout, stderr } = await execAsync(`"${binaryPath}" "${tempFilePath}" ${rows} ${cols}`);
-      
-      // Cleanup
-      await unlink(tempFilePath);
+      if (!worker) worker = new DetectWorker(binaryPath);
+      const record = await worker.detect(buffer, rowCount, colCount);
 
       try {
-          // Parse C++ output
-          // Note: stdout might contain extra logs if C++ code printed something else.
-          // We should look for the JSON part.
-          const jsonStart = stdout.indexOf('{');
-          const jsonEnd = stdout.lastIndexOf('}');
-          if (jsonStart !== -1 && jsonEnd !== -1) {
-              const jsonStr = stdout.substring(jsonStart, jsonEnd + 1);
-              const result = JSON.parse(jsonStr);
-              return NextResponse.json(result);
-          }
-          throw new Error('No JSON found in output');
-      } catch (e) {
-          console.error('Failed to parse C++ output:', stdout);
-          return NextResponse.json({ error: 'Invalid output from C++ backend', details: stdout }, { status: 500 });
+          // Decode the MessagePack record; corners arrive as packed float32 pairs.
+          const result = decodeMsgPack(record) as { [key: string]: MsgPackValue };
+          if (typeof result !== 'object' || result === null) throw new Error('Unexpected result type');
+          if ('corners' in result) result.corners = decodePoints(result.corners);
+          return NextResponse.json(result);
+      } catch (e: any) {
+          console.error('Failed to decode C++ output:', e);
+          return NextResponse.json({ error: 'Invalid output from C++ backend', details: e.message }, { status: 500 });
       }
 
     } catch (execError: any) {
-      await unlink(tempFilePath).catch(() => {});
       console.error('Execution error:', execError);
       return NextResponse.json({ error: 'Backend execution failed', details: execError.message }, { status: 500 });
     }
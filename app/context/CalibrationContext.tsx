@@ -19,6 +19,9 @@ export const CalibrationProvider: React.FC<{ children: React.ReactNode }> = ({ c
   const [isBackendWakingUp, setIsBackendWakingUp] = useState(false);
   const workerRef = useRef<Worker | null>(null);
   const promiseMap = useRef<Map<string, { resolve: Function; reject: Function }>>(new Map());
+  // Lets the local backend keep this tab's views between calibrations and
+  // only receive the ones that changed.
+  const sessionIdRef = useRef<string>(Math.random().toString(36).slice(2) + Date.now().toString(36));
 
   // Check backend status on init
   useEffect(() => {
@@ -304,7 +307,7 @@ export const CalibrationProvider: React.FC<{ children: React.ReactNode }> = ({ c
           const res = await fetch(url, {
               method: 'POST',
               headers: { 'Content-Type': 'application/json' },
-              body: JSON.stringify({ allImagePoints, objPoints, imageSize })
+              body: JSON.stringify({ allImagePoints, objPoints, imageSize, sessionId: sessionIdRef.current })
           });
           
           const result = await res.json();
@@ -0,0 +1,104 @@
+/**
+ * Minimal MessagePack decoder for the `--output=msgpack` results of the C++
+ * tools (see cpp/msgpack_writer.h). Covers every type the tools emit; bin
+ * objects are returned as Uint8Array views into the input.
+ */
+
+export type MsgPackValue =
+  | null
+  | boolean
+  | number
+  | bigint
+  | string
+  | Uint8Array
+  | MsgPackValue[]
+  | { [key: string]: MsgPackValue };
+
+const textDecoder = new TextDecoder();
+
+export function decodeMsgPack(bytes: Uint8Array): MsgPackValue {
+  const view = new DataView(bytes.buffer, bytes.byteOffset, bytes.byteLength);
+  let offset = 0;
+
+  const bin = (length: number) => {
+    const out = bytes.subarray(offset, offset + length);
+    offset += length;
+    return out;
+  };
+  const str = (length: number) => textDecoder.decode(bin(length));
+  const array = (length: number) => {
+    const out: MsgPackValue[] = [];
+    for (let i = 0; i < length; i++) out.push(next());
+    return out;
+  };
+  const map = (length: number) => {
+    const out: { [key: string]: MsgPackValue } = {};
+    for (let i = 0; i < length; i++) {
+      const key = String(next());
+      out[key] = next();
+    }
+    return out;
+  };
+  const read = <T>(size: number, get: (at: number) => T) => {
+    const value = get(offset);
+    offset += size;
+    return value;
+  };
+  const u8 = () => read(1, (at) => view.getUint8(at));
+  const u16 = () => read(2, (at) => view.getUint16(at));
+  const u32 = () => read(4, (at) => view.getUint32(at));
+
+  const next = (): MsgPackValue => {
+    if (offset >= bytes.length) throw new Error('Truncated MessagePack data');
+    const code = u8();
+    if (code < 0x80) return code;
+    if (code >= 0xe0) return code - 0x100;
+    if (code < 0x90) return map(code & 0x0f);
+    if (code < 0xa0) return array(code & 0x0f);
+    if (code < 0xc0) return str(code & 0x1f);
+    switch (code) {
+      case 0xc0: return null;
+      case 0xc2: return false;
+      case 0xc3: return true;
+      case 0xc4: return bin(u8());
+      case 0xc5: return bin(u16());
+      case 0xc6: return bin(u32());
+      case 0xca: return read(4, (at) => view.getFloat32(at));
+      case 0xcb: return read(8, (at) => view.getFloat64(at));
+      case 0xcc: return u8();
+      case 0xcd: return u16();
+      case 0xce: return u32();
+      case 0xcf: return read(8, (at) => view.getBigUint64(at));
+      case 0xd0: return read(1, (at) => view.getInt8(at));
+      case 0xd1: return read(2, (at) => view.getInt16(at));
+      case 0xd2: return read(4, (at) => view.getInt32(at));
+      case 0xd3: return read(8, (at) => view.getBigInt64(at));
+      case 0xd9: return str(u8());
+      case 0xda: return str(u16());
+      case 0xdb: return str(u32());
+      case 0xdc: return array(u16());
+      case 0xdd: return array(u32());
+      case 0xde: return map(u16());
+      case 0xdf: return map(u32());
+    }
+    throw new Error(`Unsupported MessagePack type 0x${code.toString(16)}`);
+  };
+
+  const value = next();
+  if (offset > bytes.length) throw new Error('Truncated MessagePack data');
+  return value;
+}
+
+/**
+ * Unpack a `points()` bin object (little endian float32 x, y pairs) into
+ * the `{x, y}` objects used throughout the app.
+ */
+export function decodePoints(value: MsgPackValue): { x: number; y: number }[] {
+  if (!(value instanceof Uint8Array)) return [];
+  const view = new DataView(value.buffer, value.byteOffset, value.byteLength);
+  const points = [];
+  for (let at = 0; at + 8 <= value.byteLength; at += 8) {
+    points.push({ x: view.getFloat32(at, true), y: view.getFloat32(at + 4, true) });
+  }
+  return points;
+}
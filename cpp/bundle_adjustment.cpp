@@ -0,0 +1,544 @@
+#include "bundle_adjustment.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <limits>
+#include <vector>
+
+using namespace cv;
+using namespace std;
+
+typedef Matx<double, 9, 9> Matx99d;
+typedef Matx<double, 9, 6> Matx96d;
+typedef Matx<double, 9, 1> Matx91d;
+
+static const int MAX_ITERATIONS = 100;
+// Stop once an accepted step lowers the cost by less than this fraction.
+static const double COST_TOLERANCE = 1e-12;
+// View selection tracks image plane coverage on a grid of this many cells
+// per side, one bit per cell.
+static const int COVERAGE_GRID = 8;
+
+// Intrinsics fx, fy, cx, cy, k1, k2, p1, p2, k3, and per view a pose made of
+// a rotation vector and a translation.
+struct Parameters {
+    Matx91d intrinsics;
+    vector<Matx61d> poses;
+
+    Mat cameraMatrix() const {
+        const Matx91d& a = intrinsics;
+        return Mat(Matx33d(a(0), 0, a(2), 0, a(1), a(3), 0, 0, 1));
+    }
+
+    Mat distCoeffs() const { return Mat(Matx<double, 1, 5>(&intrinsics.val[4])); }
+};
+
+// One view's part of J^T J and J^T r: its pose block V, its coupling to the
+// intrinsics W and pose gradient gb, plus its contribution to the shared
+// intrinsics block (U, ga) and to the cost.
+struct ViewEquations {
+    Matx66d V;
+    Matx96d W;
+    Matx61d gb;
+    Matx99d U;
+    Matx91d ga;
+    double cost;
+};
+
+// J^T J and J^T r in the blocks of the arrow structure: the intrinsics
+// block (U, ga) summed over all views, then the per-view blocks.
+struct NormalEquations {
+    Matx99d U;
+    Matx91d ga;
+    vector<ViewEquations> views;
+    double cost;
+};
+
+// Rotation and translation of a pose, with the derivatives of the rotation
+// matrix with respect to the three rotation vector components.
+struct ViewPose {
+    double R[9];
+    double dR[3][9];
+    double t[3];
+
+    explicit ViewPose(const Matx61d& pose);
+};
+
+// Rodrigues' formula; the derivative is the closed form of Gallego & Yezzi,
+// "A compact formula for the derivative of a 3-D rotation in exponential
+// coordinates": dR/dr_k = (r_k [r]x + [r x (I - R) e_k]x) R / |r|^2.
+ViewPose::ViewPose(const Matx61d& pose) {
+    const double* r = pose.val;
+    for (int k = 0; k < 3; k++) t[k] = pose(3 + k);
+    double theta2 = r[0] * r[0] + r[1] * r[1] + r[2] * r[2];
+    double K[9] = { 0, -r[2], r[1], r[2], 0, -r[0], -r[1], r[0], 0 };
+
+    if (theta2 < 1e-24) {
+        for (int e = 0; e < 9; e++) R[e] = (e % 4 == 0) + K[e];
+        for (int k = 0; k < 3; k++) {
+            double unit[3] = { 0, 0, 0 };
+            unit[k] = 1;
+            double E[9] = { 0, -unit[2], unit[1], unit[2], 0, -unit[0], -unit[1], unit[0], 0 };
+            for (int e = 0; e < 9; e++) dR[k][e] = E[e];
+        }
+        return;
+    }
+
+    double theta = std::sqrt(theta2);
+    double s = std::sin(theta) / theta, c = (1 - std::cos(theta)) / theta2;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            double K2 = K[3 * i] * K[j] + K[3 * i + 1] * K[3 + j] + K[3 * i + 2] * K[6 + j];
+            R[3 * i + j] = (i == j) + s * K[3 * i + j] + c * K2;
+        }
+    }
+    for (int k = 0; k < 3; k++) {
+        // v = (I - R) e_k, w = r x v
+        double v[3] = { (k == 0) - R[k], (k == 1) - R[3 + k], (k == 2) - R[6 + k] };
+        double w[3] = { r[1] * v[2] - r[2] * v[1], r[2] * v[0] - r[0] * v[2], r[0] * v[1] - r[1] * v[0] };
+        double M[9] = { 0, -w[2], w[1], w[2], 0, -w[0], -w[1], w[0], 0 };
+        for (int e = 0; e < 9; e++) M[e] = (r[k] * K[e] + M[e]) / theta2;
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                dR[k][3 * i + j] = M[3 * i] * R[j] + M[3 * i + 1] * R[3 + j] + M[3 * i + 2] * R[6 + j];
+            }
+        }
+    }
+}
+
+// Project one point. With `Ja` and `Jb`, also the derivatives of the image
+// point (u, v) with respect to the intrinsics and to the pose.
+static void projectPoint(const Matx91d& a, const ViewPose& pose, const Point3d& P, double uv[2],
+                         double Ja[2][9] = NULL, double Jb[2][6] = NULL) {
+    const double* R = pose.R;
+    double fx = a(0), fy = a(1), cx = a(2), cy = a(3);
+    double k1 = a(4), k2 = a(5), p1 = a(6), p2 = a(7), k3 = a(8);
+
+    double X = R[0] * P.x + R[1] * P.y + R[2] * P.z + pose.t[0];
+    double Y = R[3] * P.x + R[4] * P.y + R[5] * P.z + pose.t[1];
+    double Z = R[6] * P.x + R[7] * P.y + R[8] * P.z + pose.t[2];
+    double iz = Z != 0 ? 1 / Z : 1;
+    double x = X * iz, y = Y * iz;
+    double x2 = x * x, y2 = y * y, xy = x * y, r2 = x2 + y2;
+    double radial = 1 + r2 * (k1 + r2 * (k2 + r2 * k3));
+    double xd = x * radial + 2 * p1 * xy + p2 * (r2 + 2 * x2);
+    double yd = y * radial + p1 * (r2 + 2 * y2) + 2 * p2 * xy;
+    uv[0] = fx * xd + cx;
+    uv[1] = fy * yd + cy;
+    if (!Ja) return;
+
+    double r4 = r2 * r2;
+    double du[9] = { xd, 0, 1, 0, fx * x * r2, fx * x * r4, fx * 2 * xy, fx * (r2 + 2 * x2), fx * x * r4 * r2 };
+    double dv[9] = { 0, yd, 0, 1, fy * y * r2, fy * y * r4, fy * (r2 + 2 * y2), fy * 2 * xy, fy * y * r4 * r2 };
+    for (int k = 0; k < 9; k++) {
+        Ja[0][k] = du[k];
+        Ja[1][k] = dv[k];
+    }
+
+    // Through the distortion to the normalized point (x, y) ...
+    double dradial = k1 + r2 * (2 * k2 + 3 * k3 * r2);
+    double cross = 2 * xy * dradial + 2 * p1 * x + 2 * p2 * y;
+    double du_dx = fx * (radial + 2 * x2 * dradial + 2 * p1 * y + 6 * p2 * x);
+    double du_dy = fx * cross;
+    double dv_dx = fy * cross;
+    double dv_dy = fy * (radial + 2 * y2 * dradial + 6 * p1 * y + 2 * p2 * x);
+    // ... to the camera frame point, x = X / Z and y = Y / Z ...
+    double dU[3] = { du_dx * iz, du_dy * iz, -(du_dx * x + du_dy * y) * iz };
+    double dV[3] = { dv_dx * iz, dv_dy * iz, -(dv_dx * x + dv_dy * y) * iz };
+    // ... and to the pose: rotation through dR, translation directly.
+    for (int k = 0; k < 3; k++) {
+        const double* D = pose.dR[k];
+        double dX = D[0] * P.x + D[1] * P.y + D[2] * P.z;
+        double dY = D[3] * P.x + D[4] * P.y + D[5] * P.z;
+        double dZ = D[6] * P.x + D[7] * P.y + D[8] * P.z;
+        Jb[0][k] = dU[0] * dX + dU[1] * dY + dU[2] * dZ;
+        Jb[1][k] = dV[0] * dX + dV[1] * dY + dV[2] * dZ;
+        Jb[0][3 + k] = dU[k];
+        Jb[1][3 + k] = dV[k];
+    }
+}
+
+bool parseRobustLoss(const string& spec, RobustLoss& loss) {
+    size_t colon = spec.find(':');
+    string name = spec.substr(0, colon);
+    if (name == "huber") {
+        loss.kind = RobustLoss::HUBER;
+    } else if (name == "cauchy") {
+        loss.kind = RobustLoss::CAUCHY;
+    } else {
+        return false;
+    }
+    loss.scale = 1.0;
+    if (colon == string::npos) return true;
+    const char* begin = spec.c_str() + colon + 1;
+    char* end = NULL;
+    loss.scale = std::strtod(begin, &end);
+    return end != begin && *end == '\0' && loss.scale > 0;
+}
+
+// The loss of one point with squared error `e2`, and its derivative with
+// respect to e2, which is the point's weight in the reweighted normal
+// equations.
+static double pointLoss(const RobustLoss& loss, double e2, double& weight) {
+    double s2 = loss.scale * loss.scale;
+    if (loss.kind == RobustLoss::HUBER && e2 > s2) {
+        double e = std::sqrt(e2);
+        weight = loss.scale / e;
+        return 2 * loss.scale * e - s2;
+    }
+    if (loss.kind == RobustLoss::CAUCHY) {
+        weight = 1 / (1 + e2 / s2);
+        return s2 * std::log1p(e2 / s2);
+    }
+    weight = 1;
+    return e2;
+}
+
+// Total loss, without Jacobians. Views are projected in parallel and summed
+// in view order.
+static double computeCost(const vector<vector<Point3d> >& objectPoints, const vector<vector<Point2f> >& imagePoints,
+                          const Parameters& p, const RobustLoss& loss) {
+    vector<double> costs(objectPoints.size(), 0.0);
+    parallel_for_(Range(0, (int)objectPoints.size()), [&](const Range& range) {
+        for (int i = range.start; i < range.end; i++) {
+            ViewPose pose(p.poses[i]);
+            const vector<Point2f>& observed = imagePoints[i];
+            double cost = 0, uv[2], weight;
+            for (size_t j = 0; j < observed.size(); j++) {
+                projectPoint(p.intrinsics, pose, objectPoints[i][j], uv);
+                double dx = observed[j].x - uv[0];
+                double dy = observed[j].y - uv[1];
+                cost += pointLoss(loss, dx * dx + dy * dy, weight);
+            }
+            costs[i] = cost;
+        }
+    });
+    double cost = 0;
+    for (size_t i = 0; i < costs.size(); i++) cost += costs[i];
+    return cost;
+}
+
+static void buildViewEquations(const vector<Point3d>& objectPoints, const vector<Point2f>& observed,
+                               const Matx91d& intrinsics, const Matx61d& poseParameters, const RobustLoss& loss,
+                               ViewEquations& view) {
+    ViewPose pose(poseParameters);
+    view.V = Matx66d();
+    view.W = Matx96d();
+    view.gb = Matx61d();
+    view.U = Matx99d();
+    view.ga = Matx91d();
+    view.cost = 0;
+    double uv[2], Ja[2][9], Jb[2][6], weight;
+
+    for (size_t j = 0; j < observed.size(); j++) {
+        projectPoint(intrinsics, pose, objectPoints[j], uv, Ja, Jb);
+        double residual[2] = { observed[j].x - uv[0], observed[j].y - uv[1] };
+        view.cost += pointLoss(loss, residual[0] * residual[0] + residual[1] * residual[1], weight);
+        for (int k = 0; k < 2; k++) {
+            const double* ja = Ja[k];
+            const double* jb = Jb[k];
+            double r = weight * residual[k];
+            for (int a = 0; a < 9; a++) {
+                double wa = weight * ja[a];
+                for (int b = a; b < 9; b++) view.U(a, b) += wa * ja[b];
+                for (int b = 0; b < 6; b++) view.W(a, b) += wa * jb[b];
+                view.ga(a) += ja[a] * r;
+            }
+            for (int a = 0; a < 6; a++) {
+                double wb = weight * jb[a];
+                for (int b = a; b < 6; b++) view.V(a, b) += wb * jb[b];
+                view.gb(a) += jb[a] * r;
+            }
+        }
+    }
+    for (int a = 0; a < 6; a++) {
+        for (int b = 0; b < a; b++) view.V(a, b) = view.V(b, a);
+    }
+}
+
+// Assemble the normal equations. Views are independent, so each one is
+// assembled by one thread into its own slot; the shared intrinsics block is
+// then reduced in view order, which keeps the result independent of the
+// scheduling.
+static void buildNormalEquations(const vector<vector<Point3d> >& objectPoints, const vector<vector<Point2f> >& imagePoints,
+                                 const Parameters& p, const RobustLoss& loss, NormalEquations& eq) {
+    size_t views = objectPoints.size();
+    eq.views.resize(views);
+    parallel_for_(Range(0, (int)views), [&](const Range& range) {
+        for (int i = range.start; i < range.end; i++) {
+            buildViewEquations(objectPoints[i], imagePoints[i], p.intrinsics, p.poses[i], loss, eq.views[i]);
+        }
+    });
+
+    eq.U = Matx99d();
+    eq.ga = Matx91d();
+    eq.cost = 0;
+    for (size_t i = 0; i < views; i++) {
+        eq.U += eq.views[i].U;
+        eq.ga += eq.views[i].ga;
+        eq.cost += eq.views[i].cost;
+    }
+    for (int a = 0; a < 9; a++) {
+        for (int b = 0; b < a; b++) eq.U(a, b) = eq.U(b, a);
+    }
+}
+
+// Marquardt damping: scale the diagonal, with a floor for parameters the
+// data does not constrain.
+template <int n>
+static Matx<double, n, n> damped(const Matx<double, n, n>& A, double lambda) {
+    Matx<double, n, n> D = A;
+    for (int i = 0; i < n; i++) D(i, i) += lambda * std::max(A(i, i), 1e-9);
+    return D;
+}
+
+template <int n>
+static Matx<double, n, n> inverse(const Matx<double, n, n>& A) {
+    bool ok = false;
+    Matx<double, n, n> result = A.inv(DECOMP_CHOLESKY, &ok);
+    return ok ? result : A.inv(DECOMP_SVD);
+}
+
+// Solve the damped system for the step: first the intrinsics from the 9x9
+// Schur complement S = U - sum W V^-1 W^T, then every pose by back
+// substitution.
+static void solveStep(const NormalEquations& eq, double lambda, Parameters& step, vector<Matx66d>& Vinv) {
+    size_t views = eq.views.size();
+    Matx99d S = damped(eq.U, lambda);
+    Matx91d rhs = eq.ga;
+    Vinv.resize(views);
+    for (size_t i = 0; i < views; i++) {
+        const ViewEquations& view = eq.views[i];
+        Vinv[i] = inverse(damped(view.V, lambda));
+        Matx96d WVinv = view.W * Vinv[i];
+        S -= WVinv * view.W.t();
+        rhs -= WVinv * view.gb;
+    }
+    step.intrinsics = inverse(S) * rhs;
+    step.poses.resize(views);
+    for (size_t i = 0; i < views; i++) {
+        const ViewEquations& view = eq.views[i];
+        step.poses[i] = Vinv[i] * (view.gb - view.W.t() * step.intrinsics);
+    }
+}
+
+static void initialize(const CalibrationData& data, const vector<vector<Point3d> >& objectPoints,
+                       const CalibrationPrior* prior, Parameters& p) {
+    Mat K, dist = Mat::zeros(1, 5, CV_64F);
+    if (prior) {
+        prior->cameraMatrix.convertTo(K, CV_64F);
+        Mat priorDist;
+        prior->distCoeffs.convertTo(priorDist, CV_64F);
+        for (int i = 0; i < 5 && i < (int)priorDist.total(); i++) dist.at<double>(i) = priorDist.at<double>(i);
+    } else {
+        K = initCameraMatrix2D(data.objectPoints, data.imagePoints, data.imageSize);
+    }
+    p.intrinsics = Matx91d(K.at<double>(0, 0), K.at<double>(1, 1), K.at<double>(0, 2), K.at<double>(1, 2),
+                           dist.at<double>(0), dist.at<double>(1), dist.at<double>(2), dist.at<double>(3),
+                           dist.at<double>(4));
+
+    // Views are posed in parallel, each into its own slot.
+    int views = (int)objectPoints.size();
+    p.poses.resize(views);
+    vector<exception_ptr> errors(views);
+    parallel_for_(Range(0, views), [&](const Range& range) {
+        for (int i = range.start; i < range.end; i++) {
+            Mat rvec, tvec;
+            try {
+                if (prior && i < (int)prior->rvecs.size() && !prior->rvecs[i].empty()) {
+                    prior->rvecs[i].convertTo(rvec, CV_64F);
+                    prior->tvecs[i].convertTo(tvec, CV_64F);
+                } else {
+                    solvePnP(objectPoints[i], data.imagePoints[i], K, dist, rvec, tvec);
+                }
+            } catch (...) {
+                // Exceptions must not escape a worker thread; rethrown below.
+                errors[i] = current_exception();
+                continue;
+            }
+            for (int k = 0; k < 3; k++) {
+                p.poses[i](k) = rvec.at<double>(k);
+                p.poses[i](3 + k) = tvec.at<double>(k);
+            }
+        }
+    });
+    for (int i = 0; i < views; i++) {
+        if (errors[i]) rethrow_exception(errors[i]);
+    }
+}
+
+// Convert every view's object points to double precision; returns the total
+// number of points.
+static size_t loadObjectPoints(const CalibrationData& data, vector<vector<Point3d> >& objectPoints) {
+    size_t views = data.objectPoints.size();
+    CV_Assert(views > 0 && data.imagePoints.size() == views);
+    size_t totalPoints = 0;
+    objectPoints.resize(views);
+    for (size_t i = 0; i < views; i++) {
+        const Mat& points = data.objectPoints[i];
+        CV_Assert(points.type() == CV_32FC3 && points.total() == data.imagePoints[i].size());
+        objectPoints[i].resize(points.total());
+        for (size_t j = 0; j < points.total(); j++) {
+            const Point3f& point = points.at<Point3f>((int)j);
+            objectPoints[i][j] = Point3d(point.x, point.y, point.z);
+        }
+        totalPoints += data.imagePoints[i].size();
+    }
+    return totalPoints;
+}
+
+double calibrateSparse(const CalibrationData& data, CalibrationResult& result, const CalibrationPrior* prior,
+                       const RobustLoss& loss) {
+    vector<vector<Point3d> > objectPoints;
+    size_t totalPoints = loadObjectPoints(data, objectPoints);
+    size_t views = objectPoints.size();
+
+    Parameters p, step, candidate;
+    initialize(data, objectPoints, prior, p);
+    NormalEquations eq;
+    vector<Matx66d> Vinv;
+    buildNormalEquations(objectPoints, data.imagePoints, p, loss, eq);
+
+    double lambda = 1e-3;
+    for (int iteration = 0; iteration < MAX_ITERATIONS && lambda < 1e10; iteration++) {
+        solveStep(eq, lambda, step, Vinv);
+        candidate.intrinsics = p.intrinsics + step.intrinsics;
+        candidate.poses.resize(views);
+        for (size_t i = 0; i < views; i++) candidate.poses[i] = p.poses[i] + step.poses[i];
+
+        double cost = computeCost(objectPoints, data.imagePoints, candidate, loss);
+        if (!(cost < eq.cost)) {
+            lambda *= 10;
+            continue;
+        }
+        bool converged = eq.cost - cost <= COST_TOLERANCE * eq.cost;
+        std::swap(p, candidate);
+        lambda = std::max(lambda / 10, 1e-12);
+        buildNormalEquations(objectPoints, data.imagePoints, p, loss, eq);
+        if (converged) break;
+    }
+
+    result.cameraMatrix = p.cameraMatrix();
+    result.distCoeffs = p.distCoeffs();
+    result.rvecs.resize(views);
+    result.tvecs.resize(views);
+    for (size_t i = 0; i < views; i++) {
+        const Matx61d& pose = p.poses[i];
+        result.rvecs[i] = Mat(Matx31d(pose(0), pose(1), pose(2)));
+        result.tvecs[i] = Mat(Matx31d(pose(3), pose(4), pose(5)));
+    }
+    double squares = loss.kind == RobustLoss::SQUARED ? eq.cost : computeCost(objectPoints, data.imagePoints, p, RobustLoss());
+    result.rms = totalPoints > 0 ? std::sqrt(squares / totalPoints) : 0.0;
+    return result.rms;
+}
+
+// log det(A) through a Cholesky factorization; -infinity unless A is
+// positive definite.
+static double logDet(const Matx99d& A) {
+    Matx99d L;
+    double sum = 0;
+    for (int j = 0; j < 9; j++) {
+        double d = A(j, j);
+        for (int k = 0; k < j; k++) d -= L(j, k) * L(j, k);
+        if (!(d > 0)) return -std::numeric_limits<double>::infinity();
+        L(j, j) = std::sqrt(d);
+        sum += std::log(d);
+        for (int i = j + 1; i < 9; i++) {
+            double v = A(i, j);
+            for (int k = 0; k < j; k++) v -= L(i, k) * L(j, k);
+            L(i, j) = v / L(j, j);
+        }
+    }
+    return sum;
+}
+
+// Image plane cells, of a COVERAGE_GRID square grid, that a view has points in.
+static uint64_t coverage(const vector<Point2f>& points, Size imageSize) {
+    uint64_t cells = 0;
+    for (size_t j = 0; j < points.size(); j++) {
+        int cx = (int)(points[j].x * COVERAGE_GRID / std::max(imageSize.width, 1));
+        int cy = (int)(points[j].y * COVERAGE_GRID / std::max(imageSize.height, 1));
+        cx = std::min(std::max(cx, 0), COVERAGE_GRID - 1);
+        cy = std::min(std::max(cy, 0), COVERAGE_GRID - 1);
+        cells |= uint64_t(1) << (cy * COVERAGE_GRID + cx);
+    }
+    return cells;
+}
+
+static int popcount(uint64_t bits) {
+    int count = 0;
+    for (; bits; bits &= bits - 1) count++;
+    return count;
+}
+
+vector<int> selectInformativeViews(const CalibrationData& data, int count, const CalibrationPrior* prior) {
+    vector<vector<Point3d> > objectPoints;
+    loadObjectPoints(data, objectPoints);
+    int views = (int)objectPoints.size();
+    vector<int> selected;
+    if (count >= views) {
+        for (int i = 0; i < views; i++) selected.push_back(i);
+        return selected;
+    }
+
+    Parameters p;
+    initialize(data, objectPoints, prior, p);
+    NormalEquations eq;
+    buildNormalEquations(objectPoints, data.imagePoints, p, RobustLoss(), eq);
+
+    // What each view tells about the intrinsics once its own pose is
+    // eliminated: U - W V^-1 W^T, the view's term of the Schur complement.
+    vector<Matx99d> information(views);
+    Matx99d total;
+    for (int i = 0; i < views; i++) {
+        const ViewEquations& view = eq.views[i];
+        Matx99d U = view.U;
+        for (int a = 0; a < 9; a++) {
+            for (int b = 0; b < a; b++) U(a, b) = U(b, a);
+        }
+        information[i] = U - view.W * inverse(view.V) * view.W.t();
+        total += information[i];
+    }
+    // Rescale the intrinsics to comparable magnitudes. Log determinant gains
+    // do not depend on the scale; only the small regularizer that makes the
+    // first pick well defined does.
+    double scale[9];
+    for (int a = 0; a < 9; a++) scale[a] = 1 / std::sqrt(std::max(total(a, a), 1e-300));
+    for (int i = 0; i < views; i++) {
+        for (int a = 0; a < 9; a++) {
+            for (int b = 0; b < 9; b++) information[i](a, b) *= scale[a] * scale[b];
+        }
+    }
+    vector<uint64_t> cells(views);
+    for (int i = 0; i < views; i++) cells[i] = coverage(data.imagePoints[i], data.imageSize);
+
+    Matx99d S;
+    for (int a = 0; a < 9; a++) S(a, a) = 1e-6;
+    uint64_t covered = 0;
+    vector<char> taken(views, 0);
+    vector<double> gains(views);
+    for (int k = 0; k < count; k++) {
+        double base = logDet(S);
+        parallel_for_(Range(0, views), [&](const Range& range) {
+            for (int i = range.start; i < range.end; i++) {
+                gains[i] = taken[i] ? -std::numeric_limits<double>::infinity()
+                                    : logDet(S + information[i]) - base +
+                                          popcount(cells[i] & ~covered) / double(COVERAGE_GRID * COVERAGE_GRID);
+            }
+        });
+        // First best view wins ties, so the choice is deterministic.
+        int best = -1;
+        for (int i = 0; i < views; i++) {
+            if (!taken[i] && (best < 0 || gains[i] > gains[best])) best = i;
+        }
+        taken[best] = 1;
+        S += information[best];
+        covered |= cells[best];
+        selected.push_back(best);
+    }
+    std::sort(selected.begin(), selected.end());
+    return selected;
+}
@@ -0,0 +1,61 @@
+#ifndef BUNDLE_ADJUSTMENT_H
+#define BUNDLE_ADJUSTMENT_H
+
+#include <string>
+#include <vector>
+
+#include "calibration.h"
+
+// Levenberg-Marquardt calibration for large view counts.
+//
+// cv::calibrateCamera solves the normal equations of all intrinsics and 6N
+// pose parameters as one dense system, which costs O(N^3) per iteration.
+// Every residual only depends on the intrinsics and the pose of its own view,
+// so the system has an arrow shape: one small intrinsics block, a 6x6 block
+// per view and the coupling between them. Eliminating the pose blocks with
+// the Schur complement leaves a 9x9 system, making an iteration O(N).
+//
+// Same model as calibrate() with flags 0: fx, fy, cx, cy and the distortion
+// coefficients k1, k2, p1, p2, k3, zero skew. The initial intrinsics come
+// from the prior when given, otherwise from cv::initCameraMatrix2D (planar
+// boards only, as for calibrateCamera). Views get the prior's pose when it
+// has one for them, otherwise one from cv::solvePnP.
+//
+// Loss applied to each point's reprojection error e (in pixels). SQUARED is
+// plain least squares. HUBER (e^2 up to `scale`, linear beyond) and CAUCHY
+// (scale^2 log(1 + e^2 / scale^2)) grow slower for large errors, so a few
+// bad corners cannot drag the solution towards them.
+struct RobustLoss {
+    enum Kind { SQUARED, HUBER, CAUCHY };
+    Kind kind;
+    double scale;
+
+    RobustLoss(Kind kind = SQUARED, double scale = 1.0) : kind(kind), scale(scale) {}
+};
+
+// Parse a --robust=<loss>[:<scale>] value, e.g. "huber" or "cauchy:2".
+// Returns false for unknown losses and scales that are not positive.
+bool parseRobustLoss(const std::string& spec, RobustLoss& loss);
+
+// Fills the same fields of `result` as calibrate() and returns the RMS
+// reprojection error. With a robust loss every iteration reweights the
+// points by the loss (iteratively reweighted least squares); the returned
+// RMS is still the plain one. Throws cv::Exception when OpenCV rejects the
+// data.
+double calibrateSparse(const CalibrationData& data, CalibrationResult& result,
+                       const CalibrationPrior* prior = NULL, const RobustLoss& loss = RobustLoss());
+
+// Pick the `count` views that say the most about the intrinsics, so the
+// solver's cost stays bounded however many frames were captured. Starting
+// from the same initial solution as calibrateSparse(), views are taken
+// greedily by the gain in log det of the intrinsics' information matrix
+// (each view contributing its Schur complement term, so its pose is
+// accounted for) plus the fraction of a coarse image plane grid they newly
+// cover. A near-duplicate of a chosen view adds almost nothing, so diverse
+// poses win. Returns ascending view indices, every view when `count` is not
+// smaller than the number of views. Throws cv::Exception like
+// calibrateSparse().
+std::vector<int> selectInformativeViews(const CalibrationData& data, int count,
+                                        const CalibrationPrior* prior = NULL);
+
+#endif
@@ -0,0 +1,186 @@
+#include "calibcore.h"
+#include "calibration.h"
+#include "detection.h"
+
+#include <algorithm>
+#include <exception>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+using namespace cv;
+using namespace std;
+
+struct calibcore_detector {
+    DetectorState state;
+    DetectionResult result;
+    string error;
+};
+
+// What the pointers of a calibcore_calibration refer to.
+struct CalibrationStorage {
+    string error;
+    vector<double> distCoeffs;
+    vector<double> rvecs;
+    vector<double> tvecs;
+    vector<double> perViewErrors;
+};
+
+// The handle is returned as a pointer to its first member and converted back
+// in calibcore_calibration_free, which is only valid for a standard-layout
+// type. Library containers are not guaranteed to be one, so the storage is
+// allocated separately.
+struct CalibrationHandle {
+    calibcore_calibration info;
+    CalibrationStorage* storage;
+};
+static_assert(std::is_standard_layout<CalibrationHandle>::value, "CalibrationHandle must be standard layout");
+
+int calibcore_version(void) {
+    return CALIBCORE_VERSION;
+}
+
+calibcore_detector* calibcore_detector_create(void) {
+    return new (std::nothrow) calibcore_detector();
+}
+
+void calibcore_detector_destroy(calibcore_detector* detector) {
+    delete detector;
+}
+
+int calibcore_detect(calibcore_detector* detector, const unsigned char* image, size_t size,
+                     int rows, int cols, const calibcore_detect_options* options,
+                     calibcore_detection* result) {
+    if (!detector || !result) return CALIBCORE_ERROR;
+    detector->error.clear();
+    *result = calibcore_detection();
+
+    DetectOptions detectOptions;
+    if (options) {
+        detectOptions.pyramidMaxSide = options->pyramid_max_side;
+        detectOptions.hintBox = Rect(options->hint_x, options->hint_y, options->hint_width, options->hint_height);
+        detectOptions.rawSize = Size(options->raw_width, options->raw_height);
+        detectOptions.rawBits = options->raw_bits;
+    }
+
+    try {
+        DetectionResult& detection = detector->result;
+        detectCorners(image, size, rows, cols, detectOptions, detector->state, detection);
+        if (detection.status == DETECT_UNREADABLE) return CALIBCORE_UNREADABLE;
+        result->width = detection.imageSize.width;
+        result->height = detection.imageSize.height;
+        if (detection.status != DETECT_FOUND) return CALIBCORE_NOT_FOUND;
+        result->rows = detection.boardSize.height;
+        result->cols = detection.boardSize.width;
+        result->count = detection.corners.size();
+        result->corners = detection.corners.empty() ? NULL : &detection.corners[0].x;
+        return CALIBCORE_FOUND;
+    } catch (const std::exception& e) {
+        detector->error = e.what();
+    } catch (...) {
+        detector->error = "Unknown detection error";
+    }
+    return CALIBCORE_ERROR;
+}
+
+const char* calibcore_detector_error(const calibcore_detector* detector) {
+    return detector ? detector->error.c_str() : "";
+}
+
+int calibcore_refine(const unsigned char* gray, int width, int height, size_t stride,
+                     int rows, int cols, float* corners) {
+    if (!gray || !corners || width <= 0 || height <= 0 || rows <= 0 || cols <= 0) return CALIBCORE_ERROR;
+    try {
+        Mat image(height, width, CV_8UC1, (void*)gray, stride);
+        vector<Point2f> points((Point2f*)corners, (Point2f*)corners + (size_t)rows * cols);
+        refineCorners(image, Size(cols, rows), points);
+        std::copy(points.begin(), points.end(), (Point2f*)corners);
+        return 0;
+    } catch (...) {
+        return CALIBCORE_ERROR;
+    }
+}
+
+// Flatten 3-vectors (rvecs/tvecs) into one contiguous array.
+static void flattenVectors(const vector<Mat>& vectors, vector<double>& out) {
+    out.resize(3 * vectors.size());
+    for (size_t i = 0; i < vectors.size(); i++) {
+        for (int j = 0; j < 3; j++) out[3 * i + j] = vectors[i].at<double>(j);
+    }
+}
+
+calibcore_calibration* calibcore_calibrate(const void* data, size_t size, int flags) {
+    CalibrationHandle* handle = new (std::nothrow) CalibrationHandle();
+    if (!handle) return NULL;
+    handle->storage = new (std::nothrow) CalibrationStorage();
+    if (!handle->storage) {
+        delete handle;
+        return NULL;
+    }
+    calibcore_calibration& info = handle->info;
+    CalibrationStorage& storage = *handle->storage;
+    info = calibcore_calibration();
+
+    try {
+        CalibrationData dataset;
+        if (!data || !readBinaryData((const unsigned char*)data, size, dataset, storage.error)) {
+            if (storage.error.empty()) storage.error = "No calibration data";
+            info.error = storage.error.c_str();
+            return &info;
+        }
+
+        CalibrationResult result;
+        calibrate(dataset, flags, result);
+        computeReprojectionErrors(dataset, result);
+
+        info.rms = result.rms;
+        for (int i = 0; i < 9; i++) info.camera_matrix[i] = result.cameraMatrix.at<double>(i / 3, i % 3);
+        storage.distCoeffs.resize(result.distCoeffs.total());
+        for (size_t i = 0; i < storage.distCoeffs.size(); i++) storage.distCoeffs[i] = result.distCoeffs.at<double>((int)i);
+        flattenVectors(result.rvecs, storage.rvecs);
+        flattenVectors(result.tvecs, storage.tvecs);
+        storage.perViewErrors = result.perViewErrors;
+
+        info.dist_count = storage.distCoeffs.size();
+        info.dist_coeffs = storage.distCoeffs.empty() ? NULL : &storage.distCoeffs[0];
+        info.views = result.rvecs.size();
+        info.rvecs = storage.rvecs.empty() ? NULL : &storage.rvecs[0];
+        info.tvecs = storage.tvecs.empty() ? NULL : &storage.tvecs[0];
+        info.per_view_errors = storage.perViewErrors.empty() ? NULL : &storage.perViewErrors[0];
+        info.success = 1;
+    } catch (const std::exception& e) {
+        storage.error = string("OpenCV Calibration Error: ") + e.what();
+        info.error = storage.error.c_str();
+    } catch (...) {
+        storage.error = "Unknown calibration error";
+        info.error = storage.error.c_str();
+    }
+    return &info;
+}
+
+void calibcore_calibration_free(calibcore_calibration* calibration) {
+    if (!calibration) return;
+    CalibrationHandle* handle = reinterpret_cast<CalibrationHandle*>(calibration);
+    delete handle->storage;
+    delete handle;
+}
+
+int calibcore_reproject(const double camera_matrix[9], const double* dist_coeffs, size_t dist_count,
+                        const double rvec[3], const double tvec[3],
+                        const float* object_points, size_t count, float* image_points) {
+    if (!camera_matrix || !rvec || !tvec || (!dist_coeffs && dist_count > 0)) return CALIBCORE_ERROR;
+    if (count == 0) return 0;
+    if (!object_points || !image_points) return CALIBCORE_ERROR;
+    try {
+        Mat cameraMatrix(3, 3, CV_64F, (void*)camera_matrix);
+        Mat distCoeffs = dist_count > 0 ? Mat(1, (int)dist_count, CV_64F, (void*)dist_coeffs) : Mat();
+        Mat objectPoints((int)count, 1, CV_32FC3, (void*)object_points);
+        Mat projected((int)count, 1, CV_32FC2, (void*)image_points);
+        projectPoints(objectPoints, Mat(3, 1, CV_64F, (void*)rvec), Mat(3, 1, CV_64F, (void*)tvec),
+                      cameraMatrix, distCoeffs, projected);
+        return 0;
+    } catch (...) {
+        return CALIBCORE_ERROR;
+    }
+}
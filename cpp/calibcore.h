@@ -0,0 +1,115 @@
+#ifndef CALIBCORE_H
+#define CALIBCORE_H
+
+/*
+ * C API of libcalibcore: chessboard detection, corner refinement, camera
+ * calibration and reprojection in-process, without spawning the
+ * detect_corners / calibrate_camera tools. Plain C types only, so it can be
+ * loaded through N-API, an FFI or Python's ctypes.
+ *
+ * Functions never throw; failures are reported through return values and
+ * error strings. A detector handle must only be used by one thread at a time;
+ * create one per thread for concurrent detection.
+ */
+
+#include <stddef.h>
+
+#if defined(_WIN32)
+#define CALIBCORE_API __declspec(dllexport)
+#else
+#define CALIBCORE_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CALIBCORE_VERSION 1
+
+/* Version of the library actually loaded, to compare with CALIBCORE_VERSION. */
+CALIBCORE_API int calibcore_version(void);
+
+/* ---- Detection ---- */
+
+typedef struct calibcore_detector calibcore_detector;
+
+/* Optional detection settings; zero-initialize and set what is needed. */
+typedef struct {
+    /* Search a copy downscaled to at most this longest side, 0 = full size. */
+    int pyramid_max_side;
+    /* Previous frame's board box, ignored while width or height is 0. */
+    int hint_x, hint_y, hint_width, hint_height;
+    /* Headerless mono input of raw_width x raw_height pixels with raw_bits
+       (8 or 16, little endian) per pixel; raw_bits 0 = encoded image. */
+    int raw_width, raw_height, raw_bits;
+} calibcore_detect_options;
+
+#define CALIBCORE_FOUND 1
+#define CALIBCORE_NOT_FOUND 0
+#define CALIBCORE_UNREADABLE (-1)
+#define CALIBCORE_ERROR (-2)
+
+typedef struct {
+    int rows, cols;       /* inner corners of the board found */
+    int width, height;    /* native image size */
+    size_t count;         /* number of corners, rows * cols */
+    const float* corners; /* count x (x, y), row-major; owned by the detector
+                             and valid until its next call */
+} calibcore_detection;
+
+/* Returns NULL when out of memory. */
+CALIBCORE_API calibcore_detector* calibcore_detector_create(void);
+CALIBCORE_API void calibcore_detector_destroy(calibcore_detector* detector);
+
+/* Detect a rows x cols board (<= 0 auto-detects the size) in an encoded
+   image (JPEG, PNG, ...) or raw frame held in memory. `options` may be NULL.
+   Returns CALIBCORE_FOUND, CALIBCORE_NOT_FOUND, CALIBCORE_UNREADABLE or
+   CALIBCORE_ERROR (see calibcore_detector_error). */
+CALIBCORE_API int calibcore_detect(calibcore_detector* detector, const unsigned char* image, size_t size,
+                                   int rows, int cols, const calibcore_detect_options* options,
+                                   calibcore_detection* result);
+
+/* Message of the last CALIBCORE_ERROR, or "" when there was none. */
+CALIBCORE_API const char* calibcore_detector_error(const calibcore_detector* detector);
+
+/* Refine `corners` (rows x cols, row-major x, y pairs) in place to sub-pixel
+   accuracy in an 8-bit grayscale image of `stride` bytes per row. Returns 0
+   on success, CALIBCORE_ERROR otherwise. */
+CALIBCORE_API int calibcore_refine(const unsigned char* gray, int width, int height, size_t stride,
+                                   int rows, int cols, float* corners);
+
+/* ---- Calibration ---- */
+
+typedef struct {
+    int success;             /* 1 when the fields below are valid */
+    const char* error;       /* why it failed, NULL on success */
+    double rms;
+    double camera_matrix[9]; /* row-major 3x3 */
+    size_t dist_count;
+    const double* dist_coeffs;
+    size_t views;
+    const double* rvecs;     /* views x 3 */
+    const double* tvecs;     /* views x 3 */
+    const double* per_view_errors;
+} calibcore_calibration;
+
+/* Calibrate from a dataset in the packed binary "CALB" layout documented in
+   calibration.cpp (what calibrate_camera reads). `flags` are OpenCV
+   CALIB_* flags, 0 for the default model. Returns NULL only when out of
+   memory; release the result with calibcore_calibration_free. */
+CALIBCORE_API calibcore_calibration* calibcore_calibrate(const void* data, size_t size, int flags);
+CALIBCORE_API void calibcore_calibration_free(calibcore_calibration* calibration);
+
+/* Project `count` object points (X, Y, Z triples) into the image with the
+   given intrinsics and pose, writing x, y pairs to `image_points`.
+   `dist_coeffs` may be NULL when `dist_count` is 0. Returns 0 on success,
+   CALIBCORE_ERROR otherwise. */
+CALIBCORE_API int calibcore_reproject(const double camera_matrix[9], const double* dist_coeffs, size_t dist_count,
+                                      const double rvec[3], const double tvec[3],
+                                      const float* object_points, size_t count, float* image_points);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,207 @@
+// Node.js addon over the calibcore C API, so the Next.js server can detect
+// corners in-process instead of talking to a detect_corners process.
+//
+//   const addon = { exports: {} };
+//   process.dlopen(addon, 'cpp/build/calibcore.node');
+//   const result = await addon.exports.detect(buffer, rows, cols, { pyramidMaxSide: 1600 });
+//
+// detect(image: Buffer, rows: number, cols: number, options?) returns a
+// Promise of the same object detect_corners prints, except that "corners" is
+// a Float32Array of x, y pairs. Detection runs on the libuv thread pool, so
+// the event loop stays free and concurrent calls are detected in parallel.
+// Options: pyramidMaxSide (number), hintBox ([x, y, width, height]).
+//
+// Built with -DBUILD_NODE_ADDON=ON; uses only the stable N-API C interface,
+// so the binary does not depend on the Node version.
+
+#include <node_api.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+#include "calibcore.h"
+
+namespace {
+
+// One detector per thread-pool thread, so its buffers are reused across jobs
+// without ever being shared between threads.
+struct ThreadDetector {
+    calibcore_detector* detector;
+    ThreadDetector() : detector(calibcore_detector_create()) {}
+    ~ThreadDetector() { calibcore_detector_destroy(detector); }
+};
+
+struct DetectJob {
+    napi_async_work work;
+    napi_deferred deferred;
+    napi_ref imageRef;
+    const unsigned char* image;
+    size_t size;
+    int rows, cols;
+    calibcore_detect_options options;
+
+    int status;
+    calibcore_detection detection;
+    std::vector<float> corners;
+    std::string error;
+};
+
+napi_value makeNumber(napi_env env, double value) {
+    napi_value result;
+    napi_create_double(env, value, &result);
+    return result;
+}
+
+void setProperty(napi_env env, napi_value object, const char* name, napi_value value) {
+    napi_set_named_property(env, object, name, value);
+}
+
+napi_value makeFailure(napi_env env, const char* message, bool withSuccess) {
+    napi_value result, text, flag;
+    napi_create_object(env, &result);
+    if (withSuccess) {
+        napi_get_boolean(env, false, &flag);
+        setProperty(env, result, "success", flag);
+    }
+    napi_create_string_utf8(env, message, NAPI_AUTO_LENGTH, &text);
+    setProperty(env, result, "error", text);
+    return result;
+}
+
+// Thread pool: no JavaScript values may be touched here.
+void executeDetect(napi_env, void* data) {
+    DetectJob* job = static_cast<DetectJob*>(data);
+    static thread_local ThreadDetector local;
+    if (!local.detector) {
+        job->status = CALIBCORE_ERROR;
+        job->error = "Out of memory";
+        return;
+    }
+    job->status = calibcore_detect(local.detector, job->image, job->size, job->rows, job->cols,
+                                   &job->options, &job->detection);
+    if (job->status == CALIBCORE_FOUND) {
+        // The detector owns the corners only until its next call.
+        job->corners.assign(job->detection.corners, job->detection.corners + 2 * job->detection.count);
+    } else if (job->status == CALIBCORE_ERROR) {
+        job->error = calibcore_detector_error(local.detector);
+    }
+}
+
+// Main thread: build the result object and settle the promise.
+void completeDetect(napi_env env, napi_status, void* data) {
+    DetectJob* job = static_cast<DetectJob*>(data);
+    napi_value result;
+
+    if (job->status == CALIBCORE_ERROR) {
+        napi_value message, error;
+        napi_create_string_utf8(env, ("OpenCV Detection Error: " + job->error).c_str(), NAPI_AUTO_LENGTH, &message);
+        napi_create_error(env, NULL, message, &error);
+        napi_reject_deferred(env, job->deferred, error);
+    } else {
+        if (job->status == CALIBCORE_UNREADABLE) {
+            result = makeFailure(env, "Could not read image", false);
+        } else if (job->status == CALIBCORE_NOT_FOUND) {
+            std::string message = "Auto-detection failed. Could not find any valid chessboard pattern.";
+            if (job->rows > 0) {
+                message = "Chessboard pattern not found. Tried " + std::to_string(job->cols) + "x" + std::to_string(job->rows) +
+                          " and " + std::to_string(job->cols - 1) + "x" + std::to_string(job->rows - 1);
+            }
+            result = makeFailure(env, message.c_str(), true);
+        } else {
+            napi_value flag, buffer, corners;
+            void* bytes = NULL;
+            size_t length = job->corners.size() * sizeof(float);
+            napi_create_object(env, &result);
+            napi_get_boolean(env, true, &flag);
+            setProperty(env, result, "success", flag);
+            setProperty(env, result, "rows", makeNumber(env, job->detection.rows));
+            setProperty(env, result, "cols", makeNumber(env, job->detection.cols));
+            setProperty(env, result, "width", makeNumber(env, job->detection.width));
+            setProperty(env, result, "height", makeNumber(env, job->detection.height));
+            napi_create_arraybuffer(env, length, &bytes, &buffer);
+            if (length > 0) memcpy(bytes, job->corners.data(), length);
+            napi_create_typedarray(env, napi_float32_array, job->corners.size(), buffer, 0, &corners);
+            setProperty(env, result, "corners", corners);
+        }
+        napi_resolve_deferred(env, job->deferred, result);
+    }
+
+    napi_delete_reference(env, job->imageRef);
+    napi_delete_async_work(env, job->work);
+    delete job;
+}
+
+napi_value throwTypeError(napi_env env, const char* message) {
+    napi_throw_type_error(env, NULL, message);
+    return NULL;
+}
+
+bool getIntProperty(napi_env env, napi_value object, const char* name, int& value) {
+    bool has = false;
+    napi_value property;
+    if (napi_has_named_property(env, object, name, &has) != napi_ok || !has) return false;
+    napi_get_named_property(env, object, name, &property);
+    return napi_get_value_int32(env, property, &value) == napi_ok;
+}
+
+// detect(image: Buffer, rows: number, cols: number, options?: object): Promise<object>
+napi_value detect(napi_env env, napi_callback_info info) {
+    size_t argc = 4;
+    napi_value argv[4];
+    napi_get_cb_info(env, info, &argc, argv, NULL, NULL);
+    if (argc < 3) return throwTypeError(env, "detect(image, rows, cols[, options]) expects at least 3 arguments");
+
+    bool isBuffer = false;
+    napi_is_buffer(env, argv[0], &isBuffer);
+    if (!isBuffer) return throwTypeError(env, "image must be a Buffer");
+
+    DetectJob* job = new DetectJob();
+    memset(&job->options, 0, sizeof(job->options));
+    void* image = NULL;
+    napi_get_buffer_info(env, argv[0], &image, &job->size);
+    job->image = static_cast<const unsigned char*>(image);
+    if (napi_get_value_int32(env, argv[1], &job->rows) != napi_ok ||
+        napi_get_value_int32(env, argv[2], &job->cols) != napi_ok) {
+        delete job;
+        return throwTypeError(env, "rows and cols must be numbers");
+    }
+
+    napi_valuetype type = napi_undefined;
+    if (argc > 3) napi_typeof(env, argv[3], &type);
+    if (type == napi_object) {
+        getIntProperty(env, argv[3], "pyramidMaxSide", job->options.pyramid_max_side);
+        bool hasHint = false;
+        napi_has_named_property(env, argv[3], "hintBox", &hasHint);
+        if (hasHint) {
+            napi_value box, item;
+            int* fields[4] = { &job->options.hint_x, &job->options.hint_y,
+                               &job->options.hint_width, &job->options.hint_height };
+            napi_get_named_property(env, argv[3], "hintBox", &box);
+            for (uint32_t i = 0; i < 4; i++) {
+                if (napi_get_element(env, box, i, &item) != napi_ok ||
+                    napi_get_value_int32(env, item, fields[i]) != napi_ok) {
+                    delete job;
+                    return throwTypeError(env, "hintBox must be [x, y, width, height]");
+                }
+            }
+        }
+    }
+
+    // Keep the Buffer alive while the thread pool reads it.
+    napi_value promise, name;
+    napi_create_reference(env, argv[0], 1, &job->imageRef);
+    napi_create_promise(env, &job->deferred, &promise);
+    napi_create_string_utf8(env, "calibcore.detect", NAPI_AUTO_LENGTH, &name);
+    napi_create_async_work(env, NULL, name, executeDetect, completeDetect, job, &job->work);
+    napi_queue_async_work(env, job->work);
+    return promise;
+}
+
+}  // namespace
+
+NAPI_MODULE_INIT() {
+    napi_value function;
+    napi_create_function(env, "detect", NAPI_AUTO_LENGTH, detect, NULL, &function);
+    napi_set_named_property(env, exports, "detect", function);
+    return exports;
+}
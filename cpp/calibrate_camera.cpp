@@ -1,141 +1,1012 @@
 #include <opencv2/opencv.hpp>
+#include <cmath>
+#include <cstdlib>
+#include <exception>
+#include <limits>
 #include <iostream>
 #include <vector>
-#include <fstream>
-// #include <nlohmann/json.hpp> // Standard JSON lib would be nice, but let's try to parse manually or expect simple format?
-// Actually, parsing JSON in raw C++ without libs is painful.
-// Let's assume the input file contains raw numbers or a specific format.
-// Or we can require `nlohmann/json`? It's a header only lib but might not be present.
-// Let's use OpenCV's FileStorage if possible? No, that's YAML/XML.
-
-// Simpler approach:
-// The input file will be a text file where:
-// Line 1: width height
-// Line 2: N (number of images)
-// Then N blocks.
-// Each block: M (number of points)
-// Then M lines of "x y" (image points)
-// Then M lines of "X Y Z" (object points)
+#include <map>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <utility>
+#include "bundle_adjustment.h"
+#include "calibration.h"
+#include "result_writer.h"
+
+// Usage:
+//   ./calibrate_camera <data_file_path> [options]
+//       Calibrate from a data file (formats documented in calibration.cpp)
+//       and print one result.
+//   ./calibrate_camera <data_file_path> --variants=<variant>,... [options]
+//       Solve several camera models at once, one thread each, and print
+//       all results in one record (see --variants).
+//   ./calibrate_camera --server [--output=json|msgpack] [--solver=opencv|sparse]
+//                              [--robust=<loss>] [--reject=<px>] [--ransac[=<n>]]
+//                              [--ransac-threshold=<px>] [--select-views=<K>]
+//       Stay resident and keep calibration sessions in memory, so a client
+//       that adds or removes one view only sends that view and each
+//       recalibration warm-starts from the session's previous solution.
+//
+// Server protocol (line framed, one command per line, one response record
+// per command, in order):
+//   open <session> <width> <height>    start a session, replacing any with that id
+//   add <session> <view> <M> x1 y1 ... xM yM X1 Y1 Z1 ... XM YM ZM
+//                                      add a view (image points, then object
+//                                      points), or replace the view with that id
+//   remove <session> <view>            drop a view
+//   calibrate <session> [--residuals]  solve; answers with the same record as
+//                                      the one-shot mode
+//   close <session>                    forget the session
+// Ids are single words. open, add, remove and close answer
+// {"success": true, "views": <views in the session>}; any failed command
+// answers {"success": false, "error": ...}. Views keep the order they were
+// first added in. The server exits on EOF or on a line containing "quit".
+// MessagePack records are framed with a little endian uint32 size, as in
+// detect_corners --server.
+//
+// Options:
+//   --output=json|msgpack  Result encoding (default json). The MessagePack
+//                          document has the same keys (see msgpack_writer.h).
+//   --residuals            Also report every point's reprojection residual
+//                          (observed - reprojected, in pixels) under
+//                          "residuals", one list of x, y pairs per view.
+//   --init=<prior.json>    Warm start from an earlier result of this tool
+//                          (its JSON output): the optimizer starts from the
+//                          prior camera_matrix and dist_coeffs, so adding a
+//                          view to a solved set converges in a few steps.
+//   --solver=opencv|sparse Optimizer (default opencv, cv::calibrateCamera).
+//                          "sparse" eliminates the per-view poses with the
+//                          Schur complement (see bundle_adjustment.h), so
+//                          iterations grow linearly with the number of views;
+//                          use it for datasets of hundreds of views or more.
+//                          It fits the default 5-coefficient model and, with
+//                          --init, also starts from the prior's poses.
+//   --robust=huber|cauchy[:<px>]
+//                          Robust loss for the sparse solver (which it
+//                          requires) with the given scale in pixels (default
+//                          1): points with larger errors are down-weighted
+//                          instead of pulling the fit towards them.
+//   --reject=<px>          Drop outliers and recalibrate until none are left
+//                          (at most 10 rounds). A point is an outlier when its
+//                          error exceeds both <px> and 3 times the round's RMS
+//                          error, so a few gross outliers cannot get good
+//                          points rejected along with them. A view goes as a
+//                          whole once more than half of its points are
+//                          outliers or fewer than 4 remain. The result adds
+//                          "rejectedViews" (view indices) and
+//                          "rejectedPoints" ([view, point] pairs of the
+//                          remaining views); "rms" covers the points kept,
+//                          while rvecs, tvecs, perViewErrors and residuals
+//                          cover every view and point, rejected views getting
+//                          a pose from solvePnP against the final intrinsics.
+//   --ransac[=<n>]         Find the good views before the full solve: n
+//                          hypotheses (default 32) each calibrate 5 random
+//                          views, in parallel, and are scored on every view
+//                          (solvePnP, then the reprojection kernel). Only the
+//                          best one's inlier views are refined, starting from
+//                          its solution instead of any warm start; the
+//                          others are reported in "rejectedViews" as with
+//                          --reject, which can be combined with it.
+//   --ransac-threshold=<px>
+//                          RMS error up to which a view agrees with a
+//                          hypothesis (default 2).
+//   --select-views=<K>     Optimize only the K views that constrain the
+//                          intrinsics best (see selectInformativeViews in
+//                          bundle_adjustment.h), which bounds the solver's
+//                          cost on long captures. The other views are posed
+//                          against the result for validation only. The
+//                          result adds "selectedViews" (view indices) and
+//                          "validationRms", the RMS error over the points of
+//                          the views left out. --ransac and --reject then
+//                          work on the selected views.
+//   --variants=<variant>,...
+//                          Solve every listed model variant concurrently on
+//                          the one parsed dataset, e.g.
+//                          --variants=default,rational,thin_prism,fix_aspect.
+//                          A variant is one or more of default, rational,
+//                          thin_prism, tilted, fix_aspect,
+//                          fix_principal_point, zero_tangent and fix_k3,
+//                          joined with '+' (rational+fix_aspect); each names
+//                          the cv::CALIB_* flag it sets. Needs the opencv
+//                          solver and not --server. The record is
+//                          {"success": true, "time_ms": <wall time>,
+//                          "variants": [...]}, one object per variant in the
+//                          order given, holding "name", "flags", "time_ms"
+//                          and the keys of a single result (or "success":
+//                          false and "error"). Compare models by RMS and
+//                          perViewErrors with care: more coefficients never
+//                          fit worse.
 
 using namespace cv;
 using namespace std;
 
-int main(int argc, char** argv) {
-    if (argc < 2) {
-        cerr << "Usage: ./calibrate_camera <data_file_path>" << endl;
-        return 1;
+// Command line settings.
+struct CalibrateOptions {
+    OutputFormat output;
+    bool residuals;
+    string priorPath;
+    bool sparse;
+    RobustLoss loss;
+    // Outlier threshold in pixels; 0 disables rejection.
+    double rejectThreshold;
+    // Number of RANSAC hypotheses; 0 disables the consensus search.
+    int ransacHypotheses;
+    double ransacThreshold;
+    // Number of views to optimize; 0 optimizes all of them.
+    int selectViews;
+    // cv::calibrateCamera flags of the opencv solver.
+    int flags;
+    // --variants: the names and flags to solve instead of `flags`.
+    vector<pair<string, int> > variants;
+
+    CalibrateOptions()
+        : output(OUTPUT_JSON), residuals(false), sparse(false), rejectThreshold(0), ransacHypotheses(0),
+          ransacThreshold(2.0), selectViews(0), flags(0) {}
+
+    // Whether views or points can be left out of the solution.
+    bool rejects() const { return rejectThreshold > 0 || ransacHypotheses > 0; }
+};
+
+// Parse a positive number filling all of `text`.
+static bool parsePositive(const string& text, double& number) {
+    const char* begin = text.c_str();
+    char* end = NULL;
+    number = strtod(begin, &end);
+    return end != begin && *end == '\0' && number > 0;
+}
+
+// Model variants for --variants, combinable with '+'.
+static const struct {
+    const char* name;
+    int flags;
+} MODEL_FLAGS[] = {
+    { "default", 0 },
+    { "rational", CALIB_RATIONAL_MODEL },
+    { "thin_prism", CALIB_THIN_PRISM_MODEL },
+    { "tilted", CALIB_TILTED_MODEL },
+    { "fix_aspect", CALIB_FIX_ASPECT_RATIO },
+    { "fix_principal_point", CALIB_FIX_PRINCIPAL_POINT },
+    { "zero_tangent", CALIB_ZERO_TANGENT_DIST },
+    { "fix_k3", CALIB_FIX_K3 },
+};
+
+// Parse "<variant>,<variant>,..." where a variant is MODEL_FLAGS names
+// joined with '+'.
+static bool parseVariants(const string& list, vector<pair<string, int> >& variants) {
+    variants.clear();
+    istringstream in(list);
+    string variant;
+    while (getline(in, variant, ',')) {
+        int flags = 0;
+        istringstream parts(variant);
+        string part;
+        bool any = false;
+        while (getline(parts, part, '+')) {
+            size_t k = 0, count = sizeof(MODEL_FLAGS) / sizeof(MODEL_FLAGS[0]);
+            while (k < count && part != MODEL_FLAGS[k].name) k++;
+            if (k == count) return false;
+            flags |= MODEL_FLAGS[k].flags;
+            any = true;
+        }
+        if (!any) return false;
+        variants.push_back(make_pair(variant, flags));
     }
+    return !variants.empty() && list[list.size() - 1] != ',';
+}
 
-    string dataPath = argv[1];
-    ifstream infile(dataPath);
-    if (!infile.is_open()) {
-        cout << "{\"error\": \"Could not open data file\"}" << endl;
-        return 1;
+static bool parseCount(const string& text, int& count) {
+    double number = 0;
+    if (!parsePositive(text, number) || number != (int)number) return false;
+    count = (int)number;
+    return true;
+}
+
+// Parse one option; returns false for anything unknown or malformed.
+static bool parseCalibrateOption(const string& arg, CalibrateOptions& options) {
+    if (arg.compare(0, 9, "--output=") == 0) return parseOutputFormat(arg.substr(9), options.output);
+    if (arg == "--residuals") {
+        options.residuals = true;
+        return true;
+    }
+    if (arg == "--solver=opencv" || arg == "--solver=sparse") {
+        options.sparse = arg == "--solver=sparse";
+        return true;
+    }
+    if (arg.compare(0, 7, "--init=") == 0) {
+        options.priorPath = arg.substr(7);
+        return !options.priorPath.empty();
     }
+    if (arg.compare(0, 9, "--robust=") == 0) return parseRobustLoss(arg.substr(9), options.loss);
+    if (arg.compare(0, 9, "--reject=") == 0) return parsePositive(arg.substr(9), options.rejectThreshold);
+    if (arg == "--ransac") {
+        options.ransacHypotheses = 32;
+        return true;
+    }
+    if (arg.compare(0, 9, "--ransac=") == 0) return parseCount(arg.substr(9), options.ransacHypotheses);
+    if (arg.compare(0, 19, "--ransac-threshold=") == 0) return parsePositive(arg.substr(19), options.ransacThreshold);
+    if (arg.compare(0, 15, "--select-views=") == 0) return parseCount(arg.substr(15), options.selectViews);
+    if (arg.compare(0, 11, "--variants=") == 0) return parseVariants(arg.substr(11), options.variants);
+    return false;
+}
 
-    int width, height, N;
-    if (!(infile >> width >> height >> N)) {
-        cout << "{\"error\": \"Invalid data header\"}" << endl;
-        return 1;
+// Views and points dropped by --reject or --ransac, indexed as in the input.
+struct Rejections {
+    vector<int> views;
+    // (view, point) pairs of views that were kept.
+    vector<pair<int, int> > points;
+};
+
+// The views --select-views optimized, and the error of the others.
+struct Selection {
+    vector<int> views;
+    double validationRms;
+
+    Selection() : validationRms(0) {}
+};
+
+// Report input that could not be loaded.
+static void writeLoadError(ResultWriter& out, const string& message) {
+    out.beginObject(1).key("error").value(message);
+    out.endObject().endRecord();
+}
+
+// Report a failed calibration or server command.
+static void writeFailure(ResultWriter& out, const string& message) {
+    out.beginObject(2).key("success").value(false).key("error").value(message);
+    out.endObject().endRecord();
+}
+
+// Number of members writeCalibrationMembers() writes.
+static size_t calibrationMembers(const CalibrationResult& result, const Rejections* rejected,
+                                 const Selection* selection) {
+    return 7 + (result.residuals.empty() ? 0 : 1) + (rejected ? 2 : 0) + (selection ? 2 : 0);
+}
+
+// Write the members of a successful calibration into the open object, with
+// what was rejected and selected when `rejected` and `selection` are given.
+static void writeCalibrationMembers(ResultWriter& out, const CalibrationResult& result, const Rejections* rejected,
+                                    const Selection* selection) {
+    bool residuals = !result.residuals.empty();
+    out.key("success").value(true);
+    out.key("rms").value(result.rms);
+
+    out.key("camera_matrix").beginArray(3);
+    for(int i=0; i<3; i++) {
+        out.beginArray(3);
+        for(int j=0; j<3; j++) {
+            out.value(result.cameraMatrix.at<double>(i,j));
+        }
+        out.endArray();
     }
+    out.endArray();
 
-    vector<vector<Point2f>> imagePoints(N);
-    vector<vector<Point3f>> objectPoints(N);
-    Size imageSize(width, height);
+    out.key("dist_coeffs").beginArray(result.distCoeffs.total());
+    for(size_t i=0; i<result.distCoeffs.total(); i++) {
+        out.value(result.distCoeffs.at<double>((int)i));
+    }
+    out.endArray();
 
-    for (int i = 0; i < N; i++) {
-        int M;
-        infile >> M;
-        imagePoints[i].resize(M);
-        objectPoints[i].resize(M);
+    out.key("rvecs").beginArray(result.rvecs.size());
+    for(size_t i=0; i<result.rvecs.size(); i++) {
+        out.beginArray(3);
+        // rvec is 3x1 or 1x3
+        for(int j=0; j<3; j++) {
+            out.value(result.rvecs[i].at<double>(j));
+        }
+        out.endArray();
+    }
+    out.endArray();
 
-        for (int j = 0; j < M; j++) {
-            infile >> imagePoints[i][j].x >> imagePoints[i][j].y;
+    out.key("tvecs").beginArray(result.tvecs.size());
+    for(size_t i=0; i<result.tvecs.size(); i++) {
+        out.beginArray(3);
+        for(int j=0; j<3; j++) {
+            out.value(result.tvecs[i].at<double>(j));
         }
-        for (int j = 0; j < M; j++) {
-            infile >> objectPoints[i][j].x >> objectPoints[i][j].y >> objectPoints[i][j].z;
+        out.endArray();
+    }
+    out.endArray();
+
+    out.key("perViewErrors").beginArray(result.perViewErrors.size());
+    for(size_t i=0; i<result.perViewErrors.size(); i++) {
+        out.value(result.perViewErrors[i]);
+    }
+    out.endArray();
+
+    if (residuals) {
+        out.key("residuals").beginArray(result.residuals.size());
+        for (size_t i = 0; i < result.residuals.size(); i++) {
+            const vector<Point2f>& view = result.residuals[i];
+            out.points(view.empty() ? NULL : &view[0].x, view.size());
         }
+        out.endArray();
     }
 
-    Mat cameraMatrix, distCoeffs;
-    vector<Mat> rvecs, tvecs;
+    if (rejected) {
+        out.key("rejectedViews").beginArray(rejected->views.size());
+        for (size_t i = 0; i < rejected->views.size(); i++) out.value(rejected->views[i]);
+        out.endArray();
+        out.key("rejectedPoints").beginArray(rejected->points.size());
+        for (size_t i = 0; i < rejected->points.size(); i++) {
+            out.beginArray(2).value(rejected->points[i].first).value(rejected->points[i].second).endArray();
+        }
+        out.endArray();
+    }
 
-    // Fixed aspect ratio is often good for initial guess, or just default
-    // Flags: CALIB_FIX_ASPECT_RATIO ? No, usually we want full calib.
-    double rms = 0;
-    try {
-        rms = calibrateCamera(objectPoints, imagePoints, imageSize, cameraMatrix, distCoeffs, rvecs, tvecs);
-    } catch (cv::Exception& e) {
-        cout << "{\"success\": false, \"error\": \"OpenCV Calibration Error: " << e.what() << "\"}" << endl;
-        return 0;
+    if (selection) {
+        out.key("selectedViews").beginArray(selection->views.size());
+        for (size_t i = 0; i < selection->views.size(); i++) out.value(selection->views[i]);
+        out.endArray();
+        out.key("validationRms").value(selection->validationRms);
+    }
+}
+
+// Write a successful calibration as one record.
+static void writeCalibration(ResultWriter& out, const CalibrationResult& result, const Rejections* rejected,
+                             const Selection* selection) {
+    out.beginObject(calibrationMembers(result, rejected, selection));
+    writeCalibrationMembers(out, result, rejected, selection);
+    out.endObject().endRecord();
+}
+
+static const int MAX_REJECTION_ROUNDS = 10;
+// Fewest points a view keeps before it is rejected as a whole; a pose needs
+// at least 4.
+static const size_t MIN_VIEW_POINTS = 4;
+
+// Run the selected optimizer once. Throws cv::Exception.
+static void optimize(const CalibrationData& data, const CalibrationPrior* prior, const CalibrateOptions& options,
+                     CalibrationResult& result) {
+    if (options.sparse) {
+        calibrateSparse(data, result, prior, options.loss);
+    } else {
+        calibrate(data, options.flags, result, prior);
+    }
+}
+
+static const int RANSAC_SUBSET_VIEWS = 5;
+
+// The views of `data` listed in `views`. Object points are shared.
+static CalibrationData viewSubset(const CalibrationData& data, const vector<int>& views) {
+    CalibrationData subset;
+    subset.imageSize = data.imageSize;
+    for (size_t k = 0; k < views.size(); k++) {
+        subset.imagePoints.push_back(data.imagePoints[views[k]]);
+        subset.objectPoints.push_back(data.objectPoints[views[k]]);
+    }
+    return subset;
+}
+
+// Pose every view of `data` against the intrinsics in `hypothesis` and fill
+// its perViewErrors. A view that cannot be posed is an outlier of this
+// hypothesis, not a reason to drop it: it keeps an empty pose and a NaN
+// error. Throws cv::Exception only for failures of the hypothesis itself.
+static void posePerView(const CalibrationData& data, CalibrationResult& hypothesis) {
+    int views = (int)data.imagePoints.size();
+    hypothesis.rvecs.assign(views, Mat());
+    hypothesis.tvecs.assign(views, Mat());
+    vector<int> posed;
+    for (int i = 0; i < views; i++) {
+        bool ok = false;
+        try {
+            ok = solvePnP(data.objectPoints[i], data.imagePoints[i], hypothesis.cameraMatrix, hypothesis.distCoeffs,
+                          hypothesis.rvecs[i], hypothesis.tvecs[i]);
+        } catch (cv::Exception&) {
+        }
+        if (ok) {
+            posed.push_back(i);
+        } else {
+            hypothesis.rvecs[i] = Mat();
+            hypothesis.tvecs[i] = Mat();
+        }
+    }
+
+    hypothesis.perViewErrors.assign(views, numeric_limits<double>::quiet_NaN());
+    if (posed.empty()) return;
+    CalibrationResult posedResult;
+    posedResult.cameraMatrix = hypothesis.cameraMatrix;
+    posedResult.distCoeffs = hypothesis.distCoeffs;
+    for (size_t k = 0; k < posed.size(); k++) {
+        posedResult.rvecs.push_back(hypothesis.rvecs[posed[k]]);
+        posedResult.tvecs.push_back(hypothesis.tvecs[posed[k]]);
     }
+    computeReprojectionErrors(viewSubset(data, posed), posedResult);
+    for (size_t k = 0; k < posed.size(); k++) hypothesis.perViewErrors[posed[k]] = posedResult.perViewErrors[k];
+}
 
-    // Compute reprojection errors
-    vector<double> perViewErrors;
-    double totalError = 0;
+// The --ransac search. Every hypothesis calibrates a random subset of views
+// and poses all views against its intrinsics; it is scored MSAC style, every
+// view adding its squared RMS error capped at the threshold (views that
+// cannot be posed add the cap). Hypotheses run
+// in parallel and draw their subsets from their own seed, so the outcome
+// does not depend on the scheduling. Clears `keepView` for the views the
+// best hypothesis disagrees with and returns its solution in `consensus`.
+static bool findConsensus(const CalibrationData& data, const CalibrateOptions& options, vector<char>& keepView,
+                          CalibrationPrior& consensus, string& error) {
+    int views = (int)data.imagePoints.size();
+    if (views <= RANSAC_SUBSET_VIEWS) return true;
+    int count = options.ransacHypotheses;
+    double threshold2 = options.ransacThreshold * options.ransacThreshold;
+    vector<CalibrationResult> hypotheses(count);
+    vector<double> scores(count, numeric_limits<double>::infinity());
+    vector<exception_ptr> errors(count);
+
+    parallel_for_(Range(0, count), [&](const Range& range) {
+        for (int h = range.start; h < range.end; h++) {
+            // Partial Fisher-Yates shuffle.
+            RNG rng(0x5eed + h);
+            vector<int> order(views);
+            for (int i = 0; i < views; i++) order[i] = i;
+            for (int i = 0; i < RANSAC_SUBSET_VIEWS; i++) swap(order[i], order[rng.uniform(i, views)]);
+            order.resize(RANSAC_SUBSET_VIEWS);
+
+            CalibrationResult& hypothesis = hypotheses[h];
+            try {
+                optimize(viewSubset(data, order), NULL, options, hypothesis);
+                posePerView(data, hypothesis);
+            } catch (cv::Exception&) {
+                // Degenerate subsets are expected; the hypothesis just loses.
+                continue;
+            } catch (...) {
+                // Exceptions must not escape a worker thread; rethrown below.
+                errors[h] = current_exception();
+                continue;
+            }
+            double score = 0;
+            for (int i = 0; i < views; i++) {
+                double e = hypothesis.perViewErrors[i];
+                score += std::isnan(e) ? threshold2 : min(e * e, threshold2);
+            }
+            scores[h] = score;
+        }
+    });
+    for (int h = 0; h < count; h++) {
+        if (errors[h]) rethrow_exception(errors[h]);
+    }
+
+    int best = (int)(min_element(scores.begin(), scores.end()) - scores.begin());
+    if (!(scores[best] < numeric_limits<double>::infinity())) {
+        error = "RANSAC found no hypothesis: every view subset failed to calibrate";
+        return false;
+    }
+    const CalibrationResult& hypothesis = hypotheses[best];
+    int inliers = 0;
+    for (int i = 0; i < views; i++) {
+        keepView[i] = hypothesis.perViewErrors[i] <= options.ransacThreshold;
+        inliers += keepView[i];
+    }
+    if (inliers < RANSAC_SUBSET_VIEWS) {
+        error = "RANSAC found no consensus: fewer than 5 views agree on any hypothesis";
+        return false;
+    }
+    consensus.cameraMatrix = hypothesis.cameraMatrix;
+    consensus.distCoeffs = hypothesis.distCoeffs;
+    consensus.rvecs = hypothesis.rvecs;
+    consensus.tvecs = hypothesis.tvecs;
+    return true;
+}
+
+// Calibrate the views left in `keepView`. With --reject, reject the outliers
+// of that solution and repeat from it until a round rejects nothing. Leaves
+// a pose for every view of `data` in `result`. Throws cv::Exception; returns
+// false when every view was rejected.
+static bool optimizeRejecting(const CalibrationData& data, const CalibrationPrior* prior, const CalibrateOptions& options,
+                              vector<char> keepView, CalibrationResult& result, Rejections& rejected, string& error) {
+    size_t views = data.imagePoints.size();
+    vector<vector<char> > inlier(views);
+    for (size_t i = 0; i < views; i++) inlier[i].assign(data.imagePoints[i].size(), 1);
+    // The starting point of the next round, indexed as `data`.
+    CalibrationPrior start;
+    const CalibrationPrior* from = prior;
+    vector<int> kept;
+
+    for (int round = 0; round < MAX_REJECTION_ROUNDS; round++) {
+        // What is left, as a dataset of its own. Untouched views keep
+        // sharing their object points.
+        CalibrationData subset;
+        subset.imageSize = data.imageSize;
+        CalibrationPrior subsetPrior;
+        kept.clear();
+        for (size_t i = 0; i < views; i++) {
+            if (!keepView[i]) continue;
+            kept.push_back((int)i);
+            const Mat& objectPoints = data.objectPoints[i];
+            if (find(inlier[i].begin(), inlier[i].end(), 0) == inlier[i].end()) {
+                subset.imagePoints.push_back(data.imagePoints[i]);
+                subset.objectPoints.push_back(objectPoints);
+            } else {
+                vector<Point2f> imagePoints;
+                vector<Point3f> viewObjectPoints;
+                for (size_t j = 0; j < inlier[i].size(); j++) {
+                    if (!inlier[i][j]) continue;
+                    imagePoints.push_back(data.imagePoints[i][j]);
+                    viewObjectPoints.push_back(objectPoints.at<Point3f>((int)j));
+                }
+                subset.imagePoints.push_back(imagePoints);
+                subset.objectPoints.push_back(Mat(viewObjectPoints, true));
+            }
+            if (from) {
+                bool posed = i < from->rvecs.size();
+                subsetPrior.rvecs.push_back(posed ? from->rvecs[i] : Mat());
+                subsetPrior.tvecs.push_back(posed ? from->tvecs[i] : Mat());
+            }
+        }
+        if (kept.empty()) {
+            error = "Every view was rejected as an outlier";
+            return false;
+        }
+        if (from) {
+            subsetPrior.cameraMatrix = from->cameraMatrix;
+            subsetPrior.distCoeffs = from->distCoeffs;
+        }
+
+        optimize(subset, from ? &subsetPrior : NULL, options, result);
+        start.cameraMatrix = result.cameraMatrix;
+        start.distCoeffs = result.distCoeffs;
+        start.rvecs.assign(views, Mat());
+        start.tvecs.assign(views, Mat());
+        for (size_t k = 0; k < kept.size(); k++) {
+            start.rvecs[kept[k]] = result.rvecs[k];
+            start.tvecs[kept[k]] = result.tvecs[k];
+        }
+        from = &start;
+        if (options.rejectThreshold <= 0 || round + 1 == MAX_REJECTION_ROUNDS) break;
+
+        computeReprojectionErrors(subset, result, true);
+        double threshold = max(options.rejectThreshold, 3 * result.rms);
+        bool changed = false;
+        for (size_t k = 0; k < kept.size(); k++) {
+            int i = kept[k];
+            const vector<Point2f>& residuals = result.residuals[k];
+            size_t remaining = 0, outliers = 0;
+            for (size_t j = 0, r = 0; j < inlier[i].size(); j++) {
+                if (!inlier[i][j]) continue;
+                const Point2f& residual = residuals[r++];
+                if (residual.x * residual.x + residual.y * residual.y > threshold * threshold) {
+                    inlier[i][j] = 0;
+                    outliers++;
+                } else {
+                    remaining++;
+                }
+            }
+            if (outliers == 0) continue;
+            changed = true;
+            if (2 * outliers > residuals.size() || remaining < MIN_VIEW_POINTS) keepView[i] = 0;
+        }
+        if (!changed) break;
+    }
+
+    // Every view gets a pose: the solved ones their own, rejected ones one
+    // against the final intrinsics.
+    result.rvecs = start.rvecs;
+    result.tvecs = start.tvecs;
+    rejected = Rejections();
+    for (size_t i = 0; i < views; i++) {
+        if (!keepView[i]) {
+            rejected.views.push_back((int)i);
+            solvePnP(data.objectPoints[i], data.imagePoints[i], result.cameraMatrix, result.distCoeffs,
+                     result.rvecs[i], result.tvecs[i]);
+            continue;
+        }
+        for (size_t j = 0; j < inlier[i].size(); j++) {
+            if (!inlier[i][j]) rejected.points.push_back(make_pair((int)i, (int)j));
+        }
+    }
+    return true;
+}
+
+// Optimize every view of `data`, after --ransac and with --reject when
+// enabled. Throws cv::Exception.
+static bool optimizeViews(const CalibrationData& data, const CalibrationPrior* prior, const CalibrateOptions& options,
+                          CalibrationResult& result, Rejections& rejected, string& error) {
+    if (!options.rejects()) {
+        optimize(data, prior, options, result);
+        return true;
+    }
+    vector<char> keepView(data.imagePoints.size(), 1);
+    CalibrationPrior consensus;
+    if (options.ransacHypotheses > 0) {
+        if (!findConsensus(data, options, keepView, consensus, error)) return false;
+        if (!consensus.cameraMatrix.empty()) prior = &consensus;
+    }
+    return optimizeRejecting(data, prior, options, keepView, result, rejected, error);
+}
+
+// --select-views: optimize the selected views only and pose the others
+// against their solution. Throws cv::Exception.
+static bool optimizeSelected(const CalibrationData& data, const CalibrationPrior* prior, const CalibrateOptions& options,
+                             CalibrationResult& result, Rejections& rejected, vector<int>& selected, string& error) {
+    size_t views = data.imagePoints.size();
+    selected = selectInformativeViews(data, options.selectViews, prior);
+    CalibrationPrior subsetPrior;
+    if (prior) {
+        subsetPrior.cameraMatrix = prior->cameraMatrix;
+        subsetPrior.distCoeffs = prior->distCoeffs;
+        for (size_t k = 0; k < selected.size(); k++) {
+            bool posed = selected[k] < (int)prior->rvecs.size();
+            subsetPrior.rvecs.push_back(posed ? prior->rvecs[selected[k]] : Mat());
+            subsetPrior.tvecs.push_back(posed ? prior->tvecs[selected[k]] : Mat());
+        }
+    }
+    CalibrationResult subsetResult;
+    Rejections subsetRejected;
+    if (!optimizeViews(viewSubset(data, selected), prior ? &subsetPrior : NULL, options, subsetResult, subsetRejected,
+                       error)) {
+        return false;
+    }
+
+    result.rms = subsetResult.rms;
+    result.cameraMatrix = subsetResult.cameraMatrix;
+    result.distCoeffs = subsetResult.distCoeffs;
+    result.rvecs.assign(views, Mat());
+    result.tvecs.assign(views, Mat());
+    for (size_t k = 0; k < selected.size(); k++) {
+        result.rvecs[selected[k]] = subsetResult.rvecs[k];
+        result.tvecs[selected[k]] = subsetResult.tvecs[k];
+    }
+    for (size_t i = 0; i < views; i++) {
+        if (!result.rvecs[i].empty()) continue;
+        solvePnP(data.objectPoints[i], data.imagePoints[i], result.cameraMatrix, result.distCoeffs,
+                 result.rvecs[i], result.tvecs[i]);
+    }
+    rejected = Rejections();
+    for (size_t k = 0; k < subsetRejected.views.size(); k++) {
+        rejected.views.push_back(selected[subsetRejected.views[k]]);
+    }
+    for (size_t k = 0; k < subsetRejected.points.size(); k++) {
+        const pair<int, int>& point = subsetRejected.points[k];
+        rejected.points.push_back(make_pair(selected[point.first], point.second));
+    }
+    return true;
+}
+
+// Calibrate and compute the reprojection errors. On failure `error` holds
+// the message to report.
+static bool solve(const CalibrationData& data, const CalibrationPrior* prior, const CalibrateOptions& options,
+                  CalibrationResult& result, Rejections& rejected, Selection& selection, string& error) {
+    size_t views = data.imagePoints.size();
+    bool selecting = options.selectViews > 0 && options.selectViews < (int)views;
     try {
-        for (size_t i = 0; i < objectPoints.size(); i++) {
-            vector<Point2f> imagePoints2;
-            projectPoints(objectPoints[i], rvecs[i], tvecs[i], cameraMatrix, distCoeffs, imagePoints2);
-            double err = norm(imagePoints[i], imagePoints2, NORM_L2);
-            double perViewError = std::sqrt(err*err/imagePoints[i].size());
-            perViewErrors.push_back(perViewError);
-            totalError += err*err;
+        if (selecting) {
+            if (!optimizeSelected(data, prior, options, result, rejected, selection.views, error)) return false;
+        } else {
+            if (!optimizeViews(data, prior, options, result, rejected, error)) return false;
+            selection.views.resize(views);
+            for (size_t i = 0; i < views; i++) selection.views[i] = (int)i;
         }
     } catch (cv::Exception& e) {
-        cout << "{\"success\": false, \"error\": \"OpenCV Reprojection Error: " << e.what() << "\"}" << endl;
-        return 0;
+        error = string("OpenCV Calibration Error: ") + e.what();
+        return false;
+    }
+    try {
+        computeReprojectionErrors(data, result, options.residuals);
+    } catch (cv::Exception& e) {
+        error = string("OpenCV Reprojection Error: ") + e.what();
+        return false;
     }
 
-    cout << "{";
-    cout << "\"success\": true,";
-    cout << "\"rms\": " << rms << ",";
-    
-    cout << "\"camera_matrix\": [";
-    for(int i=0; i<3; i++) {
-        cout << "[";
-        for(int j=0; j<3; j++) {
-            cout << cameraMatrix.at<double>(i,j) << (j<2 ? "," : "");
+    selection.validationRms = 0;
+    if (selecting) {
+        vector<char> selected(views, 0);
+        for (size_t k = 0; k < selection.views.size(); k++) selected[selection.views[k]] = 1;
+        double squares = 0;
+        size_t points = 0;
+        for (size_t i = 0; i < views; i++) {
+            if (selected[i]) continue;
+            size_t n = data.imagePoints[i].size();
+            squares += result.perViewErrors[i] * result.perViewErrors[i] * n;
+            points += n;
         }
-        cout << "]" << (i<2 ? "," : "");
+        selection.validationRms = points > 0 ? sqrt(squares / points) : 0.0;
     }
-    cout << "],";
+    return true;
+}
+
+// One --variants solve and its outcome.
+struct VariantRun {
+    CalibrationResult result;
+    Rejections rejected;
+    Selection selection;
+    bool ok;
+    string error;
+    double milliseconds;
+
+    VariantRun() : ok(false), milliseconds(0) {}
+};
+
+static double millisecondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
 
-    cout << "\"dist_coeffs\": [";
-    for(int i=0; i<distCoeffs.total(); i++) {
-        cout << distCoeffs.at<double>(i) << (i<distCoeffs.total()-1 ? "," : "");
+// --variants: solve every variant on a thread of its own and write all of
+// them as one record. The threads only read the shared dataset and prior,
+// and each fills its own slot.
+static void runVariants(const CalibrationData& data, const CalibrationPrior* prior, const CalibrateOptions& options,
+                        ResultWriter& out) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    size_t count = options.variants.size();
+    vector<VariantRun> runs(count);
+    vector<exception_ptr> errors(count);
+
+    auto worker = [&](size_t v) {
+        chrono::steady_clock::time_point variantStart = chrono::steady_clock::now();
+        CalibrateOptions variant = options;
+        variant.flags = options.variants[v].second;
+        VariantRun& run = runs[v];
+        try {
+            run.ok = solve(data, prior, variant, run.result, run.rejected, run.selection, run.error);
+        } catch (...) {
+            // Exceptions must not escape a worker thread; rethrown below.
+            errors[v] = current_exception();
+        }
+        run.milliseconds = millisecondsSince(variantStart);
+    };
+    vector<thread> pool;
+    for (size_t v = 1; v < count; v++) pool.push_back(thread(worker, v));
+    worker(0);
+    for (size_t t = 0; t < pool.size(); t++) pool[t].join();
+    for (size_t v = 0; v < count; v++) {
+        if (errors[v]) rethrow_exception(errors[v]);
     }
-    cout << "]"; // Closed bracket for dist_coeffs
-    cout << ",";
 
-    cout << "\"rvecs\": [";
-    for(size_t i=0; i<rvecs.size(); i++) {
-        cout << "[";
-        // rvec is 3x1 or 1x3
-        for(int j=0; j<3; j++) {
-            cout << rvecs[i].at<double>(j) << (j<2 ? "," : "");
+    out.beginObject(3).key("success").value(true);
+    out.key("time_ms").value(millisecondsSince(start));
+    out.key("variants").beginArray(count);
+    for (size_t v = 0; v < count; v++) {
+        const VariantRun& run = runs[v];
+        const Rejections* rejected = options.rejects() ? &run.rejected : NULL;
+        const Selection* selection = options.selectViews > 0 ? &run.selection : NULL;
+        out.beginObject(3 + (run.ok ? calibrationMembers(run.result, rejected, selection) : 2));
+        out.key("name").value(options.variants[v].first);
+        out.key("flags").value(options.variants[v].second);
+        out.key("time_ms").value(run.milliseconds);
+        if (run.ok) {
+            writeCalibrationMembers(out, run.result, rejected, selection);
+        } else {
+            out.key("success").value(false).key("error").value(run.error);
         }
-        cout << "]" << (i<rvecs.size()-1 ? "," : "");
+        out.endObject();
     }
-    cout << "],";
+    out.endArray();
+    out.endObject().endRecord();
+}
 
-    cout << "\"tvecs\": [";
-    for(size_t i=0; i<tvecs.size(); i++) {
-        cout << "[";
-        for(int j=0; j<3; j++) {
-            cout << tvecs[i].at<double>(j) << (j<2 ? "," : "");
+// One calibration of --server mode: the views added so far, in order, and
+// the last solution, which warm-starts the next calibration.
+struct Session {
+    CalibrationData data;
+    vector<string> views;
+    CalibrationPrior prior;
+    bool solved;
+
+    Session() : solved(false) {}
+};
+
+// Parse "<M> x1 y1 ... xM yM X1 Y1 Z1 ... XM YM ZM", the rest of an add line.
+static bool parseView(istream& in, vector<Point2f>& imagePoints, Mat& objectPoints) {
+    int M = 0;
+    if (!(in >> M) || M <= 0) return false;
+    imagePoints.resize(M);
+    for (int j = 0; j < M; j++) {
+        if (!(in >> imagePoints[j].x >> imagePoints[j].y)) return false;
+    }
+    objectPoints.create(M, 1, CV_32FC3);
+    for (int j = 0; j < M; j++) {
+        Point3f& p = objectPoints.at<Point3f>(j);
+        if (!(in >> p.x >> p.y >> p.z)) return false;
+    }
+    in >> ws;
+    return in.eof();
+}
+
+// add <session> <view> <M> ...: append a view, or replace the one with the
+// same id in place.
+static bool addView(Session& session, const string& view, istream& in, string& error) {
+    vector<Point2f> imagePoints;
+    Mat objectPoints;
+    if (view.empty() || !parseView(in, imagePoints, objectPoints)) {
+        error = "Usage: add <session> <view> <M> <M x y pairs> <M X Y Z triples>";
+        return false;
+    }
+    size_t index = find(session.views.begin(), session.views.end(), view) - session.views.begin();
+    if (index == session.views.size()) {
+        session.views.push_back(view);
+        session.data.imagePoints.push_back(imagePoints);
+        session.data.objectPoints.push_back(objectPoints);
+        return true;
+    }
+    session.data.imagePoints[index].swap(imagePoints);
+    session.data.objectPoints[index] = objectPoints;
+    // The prior's pose belonged to the old points.
+    if (index < session.prior.rvecs.size()) {
+        session.prior.rvecs[index] = Mat();
+        session.prior.tvecs[index] = Mat();
+    }
+    return true;
+}
+
+// remove <session> <view>
+static bool removeView(Session& session, const string& view, string& error) {
+    size_t index = find(session.views.begin(), session.views.end(), view) - session.views.begin();
+    if (index == session.views.size()) {
+        error = "Unknown view " + view;
+        return false;
+    }
+    session.views.erase(session.views.begin() + index);
+    session.data.imagePoints.erase(session.data.imagePoints.begin() + index);
+    session.data.objectPoints.erase(session.data.objectPoints.begin() + index);
+    if (index < session.prior.rvecs.size()) {
+        session.prior.rvecs.erase(session.prior.rvecs.begin() + index);
+        session.prior.tvecs.erase(session.prior.tvecs.begin() + index);
+    }
+    return true;
+}
+
+// calibrate <session> [--residuals]: solve the session's current views,
+// starting from its previous solution when there is one.
+static void calibrateSession(Session& session, istream& in, const CalibrateOptions& serverOptions, ResultWriter& out) {
+    CalibrateOptions options = serverOptions;
+    string option;
+    while (in >> option) {
+        if (option != "--residuals") {
+            writeFailure(out, "Invalid option " + option);
+            return;
         }
-        cout << "]" << (i<tvecs.size()-1 ? "," : "");
+        options.residuals = true;
     }
-    cout << "],";
 
-    cout << "\"perViewErrors\": [";
-    for(size_t i=0; i<perViewErrors.size(); i++) {
-        cout << perViewErrors[i] << (i<perViewErrors.size()-1 ? "," : "");
+    CalibrationResult result;
+    Rejections rejected;
+    Selection selection;
+    string error;
+    if (!solve(session.data, session.solved ? &session.prior : NULL, options, result, rejected, selection, error)) {
+        writeFailure(out, error);
+        return;
     }
-    cout << "]";
-    
-    cout << "}" << endl;
+    session.prior.cameraMatrix = result.cameraMatrix;
+    session.prior.distCoeffs = result.distCoeffs;
+    session.prior.rvecs = result.rvecs;
+    session.prior.tvecs = result.tvecs;
+    session.solved = true;
+    writeCalibration(out, result, options.rejects() ? &rejected : NULL, options.selectViews > 0 ? &selection : NULL);
+}
+
+// Answer session commands from stdin until EOF, one record per command, in
+// order. Sessions live until they are closed or the process exits.
+static int runServer(const CalibrateOptions& options) {
+    static const char* const USAGE =
+        "Unknown command, expected: open <session> <width> <height> | add <session> <view> ... | "
+        "remove <session> <view> | calibrate <session> [--residuals] | close <session>";
+    map<string, Session> sessions;
+    unique_ptr<ResultWriter> out(createResultWriter(options.output, true));
+    string line;
+    while (getline(cin, line)) {
+        if (!line.empty() && line[line.size() - 1] == '\r') line.erase(line.size() - 1);
+        if (line.find_first_not_of(" \t") == string::npos) continue;
+        if (line == "quit") break;
+
+        istringstream command(line);
+        string verb, name, view;
+        command >> verb >> name;
+        map<string, Session>::iterator session = sessions.find(name);
+        string error;
+        bool ok = true;
+
+        if (verb == "open") {
+            int width = 0, height = 0;
+            ok = !name.empty() && (command >> width >> height) && width > 0 && height > 0;
+            if (ok) {
+                Session& opened = sessions[name];
+                opened = Session();
+                opened.data.imageSize = Size(width, height);
+                session = sessions.find(name);
+            } else {
+                error = "Usage: open <session> <width> <height>";
+            }
+        } else if (verb != "add" && verb != "remove" && verb != "calibrate" && verb != "close") {
+            ok = false;
+            error = USAGE;
+        } else if (session == sessions.end()) {
+            ok = false;
+            error = "Unknown session " + name;
+        } else if (verb == "add") {
+            command >> view;
+            ok = addView(session->second, view, command, error);
+        } else if (verb == "remove") {
+            command >> view;
+            ok = removeView(session->second, view, error);
+        } else if (verb == "calibrate") {
+            calibrateSession(session->second, command, options, *out);
+            out->flush();
+            continue;
+        } else {
+            sessions.erase(session);
+            session = sessions.end();
+        }
+
+        if (!ok) {
+            writeFailure(*out, error);
+        } else {
+            out->beginObject(2).key("success").value(true);
+            out->key("views").value(session == sessions.end() ? 0 : session->second.views.size());
+            out->endObject().endRecord();
+        }
+        out->flush();
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    CalibrateOptions options;
+    bool server = argc >= 2 && string(argv[1]) == "--server";
+    bool validOptions = argc >= 2;
+    for (int i = 2; validOptions && i < argc; i++) {
+        validOptions = parseCalibrateOption(argv[i], options);
+    }
+    if (!validOptions || (server && (options.residuals || !options.priorPath.empty())) ||
+        (options.loss.kind != RobustLoss::SQUARED && !options.sparse) ||
+        (!options.variants.empty() && (server || options.sparse))) {
+        cerr << "Usage: ./calibrate_camera <data_file_path> [--output=json|msgpack] [--residuals] [--init=<prior.json>]"
+                " [--solver=opencv|sparse] [--robust=huber|cauchy[:<px>]] [--reject=<px>]"
+                " [--ransac[=<n>]] [--ransac-threshold=<px>] [--select-views=<K>] [--variants=<variant>,...]" << endl;
+        cerr << "       ./calibrate_camera --server [--output=json|msgpack] [--solver=opencv|sparse]"
+                " [--robust=huber|cauchy[:<px>]] [--reject=<px>] [--ransac[=<n>]] [--ransac-threshold=<px>]"
+                " [--select-views=<K>]" << endl;
+        if (options.loss.kind != RobustLoss::SQUARED && !options.sparse) cerr << "--robust needs --solver=sparse." << endl;
+        if (!options.variants.empty() && options.sparse) cerr << "--variants needs --solver=opencv." << endl;
+        return 1;
+    }
+    if (server) return runServer(options);
+    OutputFormat format = options.output;
+
+    string dataPath = argv[1];
+    CalibrationData data;
+    string error;
+    unique_ptr<ResultWriter> out(createResultWriter(format, false, 256));
+    if (!loadCalibrationData(dataPath, data, error)) {
+        writeLoadError(*out, error);
+        out->flush();
+        return 1;
+    }
+    CalibrationPrior prior;
+    bool warmStart = !options.priorPath.empty();
+    if (warmStart && !loadCalibrationPrior(options.priorPath, prior, error)) {
+        writeLoadError(*out, error);
+        out->flush();
+        return 1;
+    }
+
+    if (!options.variants.empty()) {
+        size_t points = 0;
+        for (size_t i = 0; i < data.imagePoints.size(); i++) points += data.imagePoints[i].size();
+        size_t perVariant = 512 + 160 * data.imagePoints.size() + (options.residuals ? 40 * points : 0);
+        out.reset(createResultWriter(format, false, 64 + options.variants.size() * perVariant));
+        runVariants(data, warmStart ? &prior : NULL, options, *out);
+        out->flush();
+        return 0;
+    }
+
+    CalibrationResult result;
+    Rejections rejected;
+    Selection selection;
+    if (!solve(data, warmStart ? &prior : NULL, options, result, rejected, selection, error)) {
+        writeFailure(*out, error);
+        out->flush();
+        return 0;
+    }
+
+    // Roughly 160 bytes per view for rvecs, tvecs, perViewErrors and the
+    // view lists, plus about 40 bytes per residual and 16 per rejected point.
+    size_t points = 0;
+    for (size_t i = 0; i < result.residuals.size(); i++) points += result.residuals[i].size();
+    out.reset(createResultWriter(format, false,
+                                 512 + 160 * result.rvecs.size() + 40 * points + 16 * rejected.points.size()));
+    writeCalibration(*out, result, options.rejects() ? &rejected : NULL, options.selectViews > 0 ? &selection : NULL);
+    out->flush();
 
     return 0;
-}
\ No newline at end of file
+}
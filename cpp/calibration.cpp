@@ -0,0 +1,636 @@
+#include "calibration.h"
+#include "reprojection.h"
+
+#include <iostream>
+#include <exception>
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <iterator>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+// #include <nlohmann/json.hpp> // Standard JSON lib would be nice, but let's try to parse manually or expect simple format?
+// Actually, parsing JSON in raw C++ without libs is painful.
+// Let's assume the input file contains raw numbers or a specific format.
+// Or we can require `nlohmann/json`? It's a header only lib but might not be present.
+// Let's use OpenCV's FileStorage if possible? No, that's YAML/XML.
+
+// Simpler approach:
+// The input file will be a text file where:
+// Line 1: width height
+// Line 2: N (number of images)
+// Then N blocks.
+// Each block: M (number of points)
+// Then M lines of "x y" (image points)
+// Then M lines of "X Y Z" (object points)
+//
+// When every image shows the same board, the board can be declared once
+// instead of being repeated per image:
+// Line 1: "board" K
+// Then K lines of "X Y Z" (board points)
+// Then "width height", N and N blocks as above, except that each block only
+// has image points: M lines of "x y" when M == K (all board points, in
+// order), or M lines of "index x y" for a partial view.
+//
+// For large datasets the same content can be sent in a packed binary layout
+// instead, which skips text formatting and parsing entirely. It is detected
+// by its magic and memory-mapped. All fields are little endian:
+//   char[4]  magic "CALB"
+//   uint32   version (1)
+//   uint32   flags: bit 0 set = coordinates are float64, clear = float32
+//                   bit 1 set = shared board
+//   int32    width, int32 height
+//   uint32   N (number of images)
+//   With a shared board:
+//     uint32   K (number of board points)
+//     K x 3    board points (X, Y, Z)
+//   N blocks of:
+//     uint32   M (number of points)
+//     With a shared board and M < K:
+//       M x uint32  board indices of the visible points
+//     M x 2    image points (x, y)
+//     Without a shared board:
+//       M x 3    object points (X, Y, Z)
+
+using namespace cv;
+using namespace std;
+
+static const char BINARY_MAGIC[4] = { 'C', 'A', 'L', 'B' };
+static const uint32_t BINARY_FLAG_FLOAT64 = 1;
+static const uint32_t BINARY_FLAG_SHARED_BOARD = 2;
+
+// Object points of a view that sees the shared board points at `indices`.
+static bool boardSubset(const vector<Point3f>& board, const vector<uint32_t>& indices, Mat& objectPoints) {
+    objectPoints.create((int)indices.size(), 1, CV_32FC3);
+    for (size_t j = 0; j < indices.size(); j++) {
+        if (indices[j] >= board.size()) return false;
+        objectPoints.at<Point3f>((int)j) = board[indices[j]];
+    }
+    return true;
+}
+
+// Bounds-checked little-endian reader over a memory-mapped binary data file.
+class BinaryReader {
+public:
+    BinaryReader(const unsigned char* data, size_t size) : data_(data), size_(size), offset_(0) {}
+
+    bool readU32(uint32_t& value) {
+        if (!has(4)) return false;
+        const unsigned char* p = data_ + offset_;
+        value = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+        offset_ += 4;
+        return true;
+    }
+
+    bool readU32s(vector<uint32_t>& values, size_t count) {
+        if (count > (size_ - offset_) / 4) return false;
+        values.resize(count);
+        for (size_t i = 0; i < count; i++) readU32(values[i]);
+        return true;
+    }
+
+    // Read `count` coordinates stored as float32 or float64 into `out`.
+    bool readCoords(float* out, size_t count, bool float64) {
+        size_t width = float64 ? 8 : 4;
+        if (count > (size_ - offset_) / width) return false;
+        const unsigned char* p = data_ + offset_;
+        for (size_t i = 0; i < count; i++, p += width) {
+            if (float64) {
+                double value;
+                memcpy(&value, p, 8);
+                out[i] = (float)value;
+            } else {
+                memcpy(&out[i], p, 4);
+            }
+        }
+        offset_ += count * width;
+        return true;
+    }
+
+private:
+    bool has(size_t bytes) const { return size_ - offset_ >= bytes; }
+
+    const unsigned char* data_;
+    size_t size_;
+    size_t offset_;
+};
+
+// Parse the text format described above.
+static bool readTextData(const string& dataPath, CalibrationData& data, string& error) {
+    ifstream infile(dataPath);
+    if (!infile.is_open()) {
+        error = "Could not open data file";
+        return false;
+    }
+
+    // Optional shared board declaration
+    bool sharedBoard = false;
+    string firstToken;
+    if (infile >> firstToken && firstToken == "board") {
+        int K;
+        if (!(infile >> K) || K < 0) {
+            error = "Invalid board header";
+            return false;
+        }
+        data.board.resize(K);
+        for (int k = 0; k < K; k++) {
+            infile >> data.board[k].x >> data.board[k].y >> data.board[k].z;
+        }
+        sharedBoard = true;
+    } else {
+        infile.clear();
+        infile.seekg(0);
+    }
+
+    int width, height, N;
+    if (!(infile >> width >> height >> N)) {
+        error = "Invalid data header";
+        return false;
+    }
+
+    data.imagePoints.assign(N, vector<Point2f>());
+    data.objectPoints.assign(N, Mat());
+    data.imageSize = Size(width, height);
+
+    // One owning, refcounted copy of the board that full-board views share,
+    // so copies of `data` never point into another object's `board`.
+    Mat boardPoints = Mat(data.board, true);
+    vector<uint32_t> indices;
+    for (int i = 0; i < N; i++) {
+        int M;
+        infile >> M;
+        vector<Point2f>& imagePoints = data.imagePoints[i];
+        imagePoints.resize(M);
+
+        if (sharedBoard) {
+            if (M == (int)data.board.size()) {
+                for (int j = 0; j < M; j++) {
+                    infile >> imagePoints[j].x >> imagePoints[j].y;
+                }
+                data.objectPoints[i] = boardPoints;
+                continue;
+            }
+            indices.resize(M);
+            for (int j = 0; j < M; j++) {
+                infile >> indices[j] >> imagePoints[j].x >> imagePoints[j].y;
+            }
+            if (!boardSubset(data.board, indices, data.objectPoints[i])) {
+                error = "Board index out of range";
+                return false;
+            }
+            continue;
+        }
+
+        for (int j = 0; j < M; j++) {
+            infile >> imagePoints[j].x >> imagePoints[j].y;
+        }
+        Mat& objectPoints = data.objectPoints[i];
+        objectPoints.create(M, 1, CV_32FC3);
+        for (int j = 0; j < M; j++) {
+            Point3f& p = objectPoints.at<Point3f>(j);
+            infile >> p.x >> p.y >> p.z;
+        }
+    }
+    return true;
+}
+
+// Parse the packed binary format described above.
+bool readBinaryData(const unsigned char* bytes, size_t size, CalibrationData& data, string& error) {
+    // Callers may hand over any buffer, not only sniffed files.
+    if (size < 4 || memcmp(bytes, BINARY_MAGIC, 4) != 0) {
+        error = "Not binary calibration data";
+        return false;
+    }
+    BinaryReader reader(bytes, size);
+    uint32_t magic, version, flags, width, height, N;
+    if (!reader.readU32(magic) || !reader.readU32(version) || !reader.readU32(flags) ||
+        !reader.readU32(width) || !reader.readU32(height) || !reader.readU32(N)) {
+        error = "Invalid data header";
+        return false;
+    }
+    if (version != 1) {
+        error = "Unsupported binary data version";
+        return false;
+    }
+    bool float64 = (flags & BINARY_FLAG_FLOAT64) != 0;
+    bool sharedBoard = (flags & BINARY_FLAG_SHARED_BOARD) != 0;
+
+    uint32_t K = 0;
+    if (sharedBoard) {
+        if (!reader.readU32(K) || K > size / 12) {
+            error = "Truncated binary data";
+            return false;
+        }
+        data.board.resize(K);
+        if (K > 0 && !reader.readCoords(&data.board[0].x, 3 * (size_t)K, float64)) {
+            error = "Truncated binary data";
+            return false;
+        }
+    }
+
+    // Every view needs at least its 4-byte point count
+    if (N > size / 4) {
+        error = "Truncated binary data";
+        return false;
+    }
+    data.imagePoints.assign(N, vector<Point2f>());
+    data.objectPoints.assign(N, Mat());
+    data.imageSize = Size((int)width, (int)height);
+
+    // Shared by the full-board views, as in readTextData.
+    Mat boardPoints = Mat(data.board, true);
+    vector<uint32_t> indices;
+    for (uint32_t i = 0; i < N; i++) {
+        uint32_t M;
+        if (!reader.readU32(M) || M > size / 8) {
+            error = "Truncated binary data";
+            return false;
+        }
+        bool partial = sharedBoard && M < K;
+        if (partial && !reader.readU32s(indices, M)) {
+            error = "Truncated binary data";
+            return false;
+        }
+
+        vector<Point2f>& imagePoints = data.imagePoints[i];
+        imagePoints.resize(M);
+        // Point2f/Point3f are plain float pairs/triples, so they can be filled in place.
+        if (M > 0 && !reader.readCoords(&imagePoints[0].x, 2 * (size_t)M, float64)) {
+            error = "Truncated binary data";
+            return false;
+        }
+
+        if (partial) {
+            if (!boardSubset(data.board, indices, data.objectPoints[i])) {
+                error = "Board index out of range";
+                return false;
+            }
+        } else if (sharedBoard) {
+            if (M != K) {
+                error = "View has more points than the board";
+                return false;
+            }
+            data.objectPoints[i] = boardPoints;
+        } else {
+            Mat& objectPoints = data.objectPoints[i];
+            objectPoints.create((int)M, 1, CV_32FC3);
+            if (M > 0 && !reader.readCoords(objectPoints.ptr<float>(), 3 * (size_t)M, float64)) {
+                error = "Truncated binary data";
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Load a data file in either format, sniffing the binary magic first.
+bool loadCalibrationData(const string& dataPath, CalibrationData& data, string& error) {
+    int fd = open(dataPath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = "Could not open data file";
+        return false;
+    }
+    struct stat info;
+    char magic[4] = { 0 };
+    bool binary = fstat(fd, &info) == 0 && info.st_size >= 4 &&
+                  pread(fd, magic, 4, 0) == 4 && memcmp(magic, BINARY_MAGIC, 4) == 0;
+    if (!binary) {
+        close(fd);
+        return readTextData(dataPath, data, error);
+    }
+
+    void* mapping = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        error = "Could not map data file";
+        return false;
+    }
+    bool ok = readBinaryData((const unsigned char*)mapping, (size_t)info.st_size, data, error);
+    munmap(mapping, (size_t)info.st_size);
+    return ok;
+}
+
+// Minimal reader for the JSON documents calibrate_camera writes: extracts
+// numbers and arrays of numbers, and skips any other value.
+class JsonReader {
+public:
+    explicit JsonReader(const string& text) : text_(text), pos_(0) {}
+
+    // Consume `c` if it is the next non-blank character.
+    bool consume(char c) {
+        skipSpace();
+        if (pos_ >= text_.size() || text_[pos_] != c) return false;
+        pos_++;
+        return true;
+    }
+
+    bool atEnd() {
+        skipSpace();
+        return pos_ == text_.size();
+    }
+
+    bool readString(string& value) {
+        value.clear();
+        if (!consume('"')) return false;
+        while (pos_ < text_.size()) {
+            char c = text_[pos_++];
+            if (c == '"') return true;
+            if (c == '\\') {
+                if (pos_ >= text_.size()) return false;
+                c = text_[pos_++];
+                // Only keys are compared and they are plain ASCII, so
+                // escapes just need to be stepped over.
+                if (c == 'u') pos_ += 4;
+            }
+            value += c;
+        }
+        return false;
+    }
+
+    bool readNumber(double& value) {
+        skipSpace();
+        const char* start = text_.c_str() + pos_;
+        char* end;
+        value = strtod(start, &end);
+        if (end == start) return false;
+        pos_ += end - start;
+        return true;
+    }
+
+    // [n, n, ...]
+    bool readNumbers(vector<double>& values) {
+        values.clear();
+        if (!consume('[')) return false;
+        if (consume(']')) return true;
+        do {
+            double value;
+            if (!readNumber(value)) return false;
+            values.push_back(value);
+        } while (consume(','));
+        return consume(']');
+    }
+
+    // [[n, ...], [n, ...], ...]
+    bool readNumberLists(vector<vector<double> >& lists) {
+        lists.clear();
+        if (!consume('[')) return false;
+        if (consume(']')) return true;
+        do {
+            lists.push_back(vector<double>());
+            if (!readNumbers(lists.back())) return false;
+        } while (consume(','));
+        return consume(']');
+    }
+
+    bool skipValue() {
+        skipSpace();
+        if (pos_ >= text_.size()) return false;
+        char c = text_[pos_];
+        if (c == '"') {
+            string ignored;
+            return readString(ignored);
+        }
+        if (c == '[' || c == '{') {
+            char close = c == '[' ? ']' : '}';
+            pos_++;
+            if (consume(close)) return true;
+            do {
+                string key;
+                if (close == '}' && !(readString(key) && consume(':'))) return false;
+                if (!skipValue()) return false;
+            } while (consume(','));
+            return consume(close);
+        }
+        static const char* const literals[] = { "true", "false", "null" };
+        for (size_t i = 0; i < 3; i++) {
+            size_t length = strlen(literals[i]);
+            if (text_.compare(pos_, length, literals[i]) == 0) {
+                pos_ += length;
+                return true;
+            }
+        }
+        double ignored;
+        return readNumber(ignored);
+    }
+
+private:
+    void skipSpace() {
+        while (pos_ < text_.size() && isspace((unsigned char)text_[pos_])) pos_++;
+    }
+
+    const string& text_;
+    size_t pos_;
+};
+
+// Convert lists of 3 numbers to 3x1 CV_64F vectors.
+static bool toVectors(const vector<vector<double> >& lists, vector<Mat>& vectors) {
+    vectors.clear();
+    for (size_t i = 0; i < lists.size(); i++) {
+        if (lists[i].size() != 3) return false;
+        vectors.push_back(Mat(lists[i], true));
+    }
+    return true;
+}
+
+bool parseCalibrationPrior(const string& json, CalibrationPrior& prior, string& error) {
+    prior = CalibrationPrior();
+    JsonReader reader(json);
+    vector<vector<double> > lists;
+    vector<double> numbers;
+    bool ok = reader.consume('{');
+    bool empty = ok && reader.consume('}');
+    if (ok && !empty) {
+        do {
+            string key;
+            ok = reader.readString(key) && reader.consume(':');
+            if (!ok) break;
+            if (key == "camera_matrix") {
+                ok = reader.readNumberLists(lists) && lists.size() == 3;
+                for (size_t i = 0; ok && i < 3; i++) ok = lists[i].size() == 3;
+                if (ok) {
+                    prior.cameraMatrix.create(3, 3, CV_64F);
+                    for (int i = 0; i < 9; i++) prior.cameraMatrix.at<double>(i / 3, i % 3) = lists[i / 3][i % 3];
+                }
+            } else if (key == "dist_coeffs") {
+                ok = reader.readNumbers(numbers);
+                if (ok) prior.distCoeffs = Mat(numbers, true).reshape(1, 1);
+            } else if (key == "rvecs") {
+                ok = reader.readNumberLists(lists) && toVectors(lists, prior.rvecs);
+            } else if (key == "tvecs") {
+                ok = reader.readNumberLists(lists) && toVectors(lists, prior.tvecs);
+            } else {
+                ok = reader.skipValue();
+            }
+        } while (ok && reader.consume(','));
+        ok = ok && reader.consume('}');
+    }
+    if (!ok || !reader.atEnd()) {
+        error = "Invalid prior: expected a calibrate_camera JSON result";
+        return false;
+    }
+    if (prior.cameraMatrix.empty()) {
+        error = "Invalid prior: no camera_matrix";
+        return false;
+    }
+    // An empty guess next to CALIB_USE_INTRINSIC_GUESS is not a warm start.
+    if (prior.distCoeffs.empty()) {
+        error = "Invalid prior: no dist_coeffs";
+        return false;
+    }
+    if (prior.rvecs.size() != prior.tvecs.size()) {
+        error = "Invalid prior: rvecs and tvecs differ in length";
+        return false;
+    }
+    return true;
+}
+
+bool loadCalibrationPrior(const string& path, CalibrationPrior& prior, string& error) {
+    ifstream in(path, ios::binary);
+    if (!in.is_open()) {
+        error = "Could not open prior file";
+        return false;
+    }
+    string json((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    return parseCalibrationPrior(json, prior, error);
+}
+
+double calibrate(const CalibrationData& data, int flags, CalibrationResult& result, const CalibrationPrior* prior) {
+    if (prior) {
+        // Start the optimizer from the earlier intrinsics instead of the
+        // closed-form estimate. The prior's poses are ignored here (they
+        // only seed calibrateSparse).
+        prior->cameraMatrix.copyTo(result.cameraMatrix);
+        prior->distCoeffs.copyTo(result.distCoeffs);
+        flags |= CALIB_USE_INTRINSIC_GUESS;
+    }
+    // Fixed aspect ratio is often good for initial guess, or just default
+    // Flags: CALIB_FIX_ASPECT_RATIO ? No, usually we want full calib.
+    result.rms = calibrateCamera(data.objectPoints, data.imagePoints, data.imageSize,
+                                 result.cameraMatrix, result.distCoeffs, result.rvecs, result.tvecs, flags);
+    return result.rms;
+}
+
+// Whether the solution fits the model of the reprojection kernel: zero skew
+// and at most the 5 default distortion coefficients (k1, k2, p1, p2, k3).
+static bool fitsFastModel(const CalibrationResult& result) {
+    const Mat& K = result.cameraMatrix;
+    const Mat& dist = result.distCoeffs;
+    if (K.type() != CV_64F || K.rows != 3 || K.cols != 3 || K.at<double>(0, 1) != 0) return false;
+    if (dist.empty()) return true;
+    if (dist.type() != CV_64F || (dist.rows != 1 && dist.cols != 1)) return false;
+    for (int i = 5; i < (int)dist.total(); i++) {
+        if (dist.at<double>(i) != 0) return false;
+    }
+    return true;
+}
+
+static ViewProjection viewProjection(const CalibrationResult& result, int view) {
+    const Mat& K = result.cameraMatrix;
+    const Mat& dist = result.distCoeffs;
+    double d[5] = { 0, 0, 0, 0, 0 };
+    for (int i = 0; i < 5 && i < (int)dist.total(); i++) d[i] = dist.at<double>(i);
+
+    Mat R;
+    Rodrigues(result.rvecs[view], R);
+    const Mat& t = result.tvecs[view];
+    ViewProjection projection;
+    projection.fx = (float)K.at<double>(0, 0);
+    projection.fy = (float)K.at<double>(1, 1);
+    projection.cx = (float)K.at<double>(0, 2);
+    projection.cy = (float)K.at<double>(1, 2);
+    projection.k1 = (float)d[0];
+    projection.k2 = (float)d[1];
+    projection.p1 = (float)d[2];
+    projection.p2 = (float)d[3];
+    projection.k3 = (float)d[4];
+    for (int i = 0; i < 9; i++) projection.r[i] = (float)R.at<double>(i / 3, i % 3);
+    for (int i = 0; i < 3; i++) projection.t[i] = (float)t.at<double>(i);
+    return projection;
+}
+
+// Squared error of one view through the SIMD kernel. `scratch` holds the
+// view in structure-of-arrays form and is reused across views.
+static double reprojectFast(const ViewProjection& projection, const Mat& objectPoints,
+                            const vector<Point2f>& observed, vector<float>& scratch,
+                            vector<Point2f>* residuals) {
+    size_t n = observed.size();
+    CV_Assert(objectPoints.type() == CV_32FC3 && objectPoints.isContinuous() && objectPoints.total() == n);
+    scratch.resize(7 * n);
+    float* X = scratch.data();
+    float *Y = X + n, *Z = Y + n, *u = Z + n, *v = u + n, *du = v + n, *dv = du + n;
+    const Point3f* object = objectPoints.ptr<Point3f>();
+    for (size_t j = 0; j < n; j++) {
+        X[j] = object[j].x;
+        Y[j] = object[j].y;
+        Z[j] = object[j].z;
+        u[j] = observed[j].x;
+        v[j] = observed[j].y;
+    }
+
+    ReprojectionPoints points = { X, Y, Z, u, v, residuals ? du : NULL, residuals ? dv : NULL, n };
+    double sum = reprojectionSquaredError(projection, points);
+    if (residuals) {
+        residuals->resize(n);
+        for (size_t j = 0; j < n; j++) (*residuals)[j] = Point2f(du[j], dv[j]);
+    }
+    return sum;
+}
+
+// Squared error of one view through cv::projectPoints, for any model.
+static double reprojectGeneric(const CalibrationResult& result, int view, const Mat& objectPoints,
+                               const vector<Point2f>& observed, vector<Point2f>& projected,
+                               vector<Point2f>* residuals) {
+    projectPoints(objectPoints, result.rvecs[view], result.tvecs[view], result.cameraMatrix, result.distCoeffs, projected);
+    double sum = 0;
+    for (size_t j = 0; j < observed.size(); j++) {
+        double dx = observed[j].x - projected[j].x;
+        double dy = observed[j].y - projected[j].y;
+        sum += dx * dx + dy * dy;
+    }
+    if (residuals) {
+        residuals->resize(observed.size());
+        for (size_t j = 0; j < observed.size(); j++) (*residuals)[j] = observed[j] - projected[j];
+    }
+    return sum;
+}
+
+void computeReprojectionErrors(const CalibrationData& data, CalibrationResult& result, bool residuals) {
+    const vector<vector<Point2f> >& imagePoints = data.imagePoints;
+    const vector<Mat>& objectPoints = data.objectPoints;
+    int views = (int)objectPoints.size();
+    bool fast = fitsFastModel(result);
+    result.perViewErrors.assign(views, 0.0);
+    result.residuals.assign(residuals ? views : 0, vector<Point2f>());
+    vector<exception_ptr> errors(views);
+
+    // Views are independent, so they are spread over OpenCV's thread pool.
+    // Every view is summed by a single thread in point order and written to
+    // its own slot, so the results do not depend on how views were scheduled.
+    parallel_for_(Range(0, views), [&](const Range& range) {
+        vector<Point2f> projected;
+        vector<float> scratch;
+        for (int i = range.start; i < range.end; i++) {
+            const vector<Point2f>& observed = imagePoints[i];
+            vector<Point2f>* viewResiduals = residuals ? &result.residuals[i] : NULL;
+            double sum;
+            try {
+                sum = fast ? reprojectFast(viewProjection(result, i), objectPoints[i], observed, scratch, viewResiduals)
+                           : reprojectGeneric(result, i, objectPoints[i], observed, projected, viewResiduals);
+            } catch (...) {
+                // Exceptions must not escape a worker thread; rethrown below.
+                errors[i] = current_exception();
+                continue;
+            }
+            result.perViewErrors[i] = observed.empty() ? 0.0 : std::sqrt(sum / observed.size());
+        }
+    });
+
+    // Report the failure of the first view that failed, as the serial loop did.
+    for (int i = 0; i < views; i++) {
+        if (errors[i]) rethrow_exception(errors[i]);
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+// Camera calibration from detected board corners, shared by the
+// calibrate_camera tool and the calibcore library (see calibcore.h).
+
+// Parsed calibration input.
+struct CalibrationData {
+    cv::Size imageSize;
+    std::vector<std::vector<cv::Point2f> > imagePoints;
+    // Per-view object points (CV_32FC3, one point per row). Views that see
+    // the whole shared board share one refcounted copy of `board`.
+    std::vector<cv::Mat> objectPoints;
+    std::vector<cv::Point3f> board;
+};
+
+struct CalibrationResult {
+    double rms;
+    cv::Mat cameraMatrix;
+    cv::Mat distCoeffs;
+    std::vector<cv::Mat> rvecs;
+    std::vector<cv::Mat> tvecs;
+    // RMS reprojection error of each view, in pixels.
+    std::vector<double> perViewErrors;
+    // Per-point residuals (observed - reprojected) of each view, in pixels;
+    // only filled when requested.
+    std::vector<std::vector<cv::Point2f> > residuals;
+
+    CalibrationResult() : rms(0) {}
+};
+
+// An earlier solution to warm-start calibration from, as read from a
+// calibrate_camera JSON result.
+struct CalibrationPrior {
+    cv::Mat cameraMatrix;
+    cv::Mat distCoeffs;
+    // Poses of the views the prior was solved with, in data order; views
+    // past their end, or whose entries are empty, are new.
+    // cv::calibrateCamera re-derives poses itself, so only the intrinsics
+    // seed calibrate(); calibrateSparse() starts from these poses too.
+    std::vector<cv::Mat> rvecs;
+    std::vector<cv::Mat> tvecs;
+};
+
+// Load a data file in the text or the packed binary format (both documented
+// in calibration.cpp). On failure `error` says why.
+bool loadCalibrationData(const std::string& dataPath, CalibrationData& data, std::string& error);
+
+// Parse the packed binary format from memory.
+bool readBinaryData(const unsigned char* bytes, size_t size, CalibrationData& data, std::string& error);
+
+// Read a prior from a calibrate_camera JSON result ("camera_matrix" and
+// "dist_coeffs" are required, "rvecs" and "tvecs" optional; other keys are
+// ignored).
+bool loadCalibrationPrior(const std::string& path, CalibrationPrior& prior, std::string& error);
+bool parseCalibrationPrior(const std::string& json, CalibrationPrior& prior, std::string& error);
+
+// Run cv::calibrateCamera with `flags` over every view and return the RMS
+// reprojection error. With a prior the optimizer starts from its intrinsics
+// (CALIB_USE_INTRINSIC_GUESS) instead of estimating them from scratch.
+// Throws cv::Exception when OpenCV rejects the data.
+double calibrate(const CalibrationData& data, int flags, CalibrationResult& result,
+                 const CalibrationPrior* prior = NULL);
+
+// Fill result.perViewErrors (and result.residuals when `residuals` is set) by
+// reprojecting every view with the solution. Views are processed in parallel;
+// the default 5-coefficient model goes through the SIMD kernel in
+// reprojection.h, anything else through cv::projectPoints.
+void computeReprojectionErrors(const CalibrationData& data, CalibrationResult& result, bool residuals = false);
+
+#endif
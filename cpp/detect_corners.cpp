@@ -2,137 +2,523 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <sstream>
+#include <fstream>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "detection.h"
+#include "result_writer.h"
+
+// Usage:
+//   ./detect_corners <image_path> <rows> <cols> [options]
+//       Detect a single image and print one JSON object. Besides a file path,
+//       <image_path> may be "-" (image bytes on stdin), "shm:<name>" (a POSIX
+//       shared memory segment) or "fd:<n>" (an inherited descriptor such as a
+//       memfd), so callers can hand images over without touching the disk.
+//   ./detect_corners --server [options]
+//       Stay resident and answer detection jobs read from stdin, so callers
+//       only pay process startup and OpenCV initialization once.
+//   ./detect_corners --batch <list_file|directory|glob> <rows> <cols> [--threads N] [--unordered] [options]
+//       Detect every image of a dataset in one process and print one JSON
+//       line per image, tagged with its "image" path. A list file holds one
+//       image path per line (blank lines and lines starting with '#' are
+//       skipped); a directory is scanned for image files; anything containing
+//       '*' or '?' is expanded as a glob pattern.
+//       Images are detected concurrently by N worker threads (default: all
+//       cores). Lines come out in input order unless --unordered is given, in
+//       which case each line is printed as soon as its image is done.
+//
+// Server protocol (line framed, one job per line):
+//   request:  <rows> <cols> [options] <image_path>   (image_path runs to the end of the line)
+//   response: the same JSON object the single-image mode prints, on one line.
+// Options on a job line apply to that job only, on top of the server's own;
+// --output is the exception and rejects the job.
+// A job whose path is "-" carries its image inline: exactly --bytes=<count>
+// bytes of encoded (or --raw) image follow the job line's newline.
+// The server exits on EOF or on a line containing "quit".
+//
+// Options (every mode):
+//   --output=json|msgpack Result encoding (default json). MessagePack results
+//                         have the same keys, with "corners" as a bin of
+//                         float32 x, y pairs (see msgpack_writer.h). In server
+//                         and batch modes each MessagePack record is preceded
+//                         by its size as a little endian uint32 instead of
+//                         ending with a newline. Applies to the whole process;
+//                         it cannot be changed per server job.
+//   --pyramid[=max_side]  Find the board on a copy downscaled so its longest
+//                         side is at most max_side (default 1600), then refine
+//                         the corners at full resolution. For large images.
+//   --hint-box=x,y,w,h    Where the board was in the previous frame. The search
+//                         is restricted to that box grown by half its size and
+//                         falls back to the whole image if nothing is found.
+//   --hint-corners=x1,y1,x2,y2,...
+//                         The previous frame's corners; restricts the search
+//                         like --hint-box and tries matching board sizes first.
+//                         Of --hint-box and --hint-corners the last one given
+//                         applies, so a job's hint replaces the server's.
+//   --bytes=<count>       Size of an image handed over on stdin, in shared
+//                         memory or through a descriptor.
+//   --raw=<width>x<height>[:16]
+//                         The input is a headerless 8-bit (or 16-bit little
+//                         endian) mono frame instead of an encoded image.
 
 using namespace cv;
 using namespace std;
 
-int main(int argc, char** argv) {
-    // Expected args: <image_path> <rows> <cols>
-    if (argc < 4) {
-        cout << "{\"error\": \"Usage: ./detect_corners <image_path> <rows> <cols>\"}" << endl;
+// Detection settings plus how results are written.
+struct ToolOptions : DetectOptions {
+    // Result encoding, and whether records are framed for streaming (server
+    // and batch modes).
+    OutputFormat output;
+    bool framed;
+
+    ToolOptions() : output(OUTPUT_JSON), framed(false) {}
+};
+
+// Report an error that is not tied to a particular image.
+static void writeError(const ToolOptions& options, const string& message) {
+    unique_ptr<ResultWriter> out(createResultWriter(options.output, options.framed, 256));
+    out->beginObject(1).key("error").value(message);
+    out->endObject().endRecord();
+    out->flush();
+}
+
+// What one thread needs to detect image after image: the detector's working
+// buffers, the result and the writer, all reused between images.
+struct DetectContext {
+    DetectorState state;
+    DetectionResult result;
+    unique_ptr<ResultWriter> out;
+
+    explicit DetectContext(const ToolOptions& options)
+        : out(createResultWriter(options.output, options.framed)) {}
+};
+
+// Open a result object with `members` members besides the image tag. Batch
+// records are tagged with their image path.
+static void beginResult(ResultWriter& out, const string& imagePath, bool tagImage, size_t members) {
+    out.beginObject(members + (tagImage ? 1 : 0));
+    if (tagImage) {
+        out.key("image").value(imagePath);
+    }
+}
+
+// Write a complete failed-detection record.
+static void writeFailure(ResultWriter& out, const string& imagePath, bool tagImage, const string& message) {
+    beginResult(out, imagePath, tagImage, 2);
+    out.key("success").value(false);
+    out.key("error").value(message);
+    out.endObject().endRecord();
+}
+
+// Detect chessboard corners in one image and append the result to `out`.
+static void detectImage(const string& imagePath, int rows, int cols, const ToolOptions& options,
+                        DetectContext& context, ResultWriter& out, bool tagImage = false) {
+    DetectionResult& result = context.result;
+    detectCorners(imagePath, rows, cols, options, context.state, result);
+
+    if (result.status == DETECT_UNREADABLE) {
+        beginResult(out, imagePath, tagImage, 1);
+        out.key("error").value("Could not read image at " + imagePath);
+        out.endObject().endRecord();
+    } else if (result.status == DETECT_FOUND) {
+        const vector<Point2f>& corners = result.corners;
+        beginResult(out, imagePath, tagImage, 6);
+        out.key("success").value(true);
+        out.key("rows").value(result.boardSize.height);
+        out.key("cols").value(result.boardSize.width);
+        out.key("width").value(result.imageSize.width);
+        out.key("height").value(result.imageSize.height);
+        out.key("corners").points(corners.empty() ? NULL : &corners[0].x, corners.size());
+        out.endObject().endRecord();
+    } else {
+        if (rows > 0) {
+             writeFailure(out, imagePath, tagImage, "Chessboard pattern not found. Tried " +
+                          to_string(cols) + "x" + to_string(rows) + " and " + to_string(cols-1) + "x" + to_string(rows-1));
+        } else {
+             writeFailure(out, imagePath, tagImage, "Auto-detection failed. Could not find any valid chessboard pattern.");
+        }
+    }
+}
+
+// Parse a comma separated list of numbers; any malformed entry empties the list.
+static vector<float> parseNumberList(const string& text) {
+    vector<float> values;
+    istringstream in(text);
+    string item;
+    while (getline(in, item, ',')) {
+        char* end = NULL;
+        float value = strtof(item.c_str(), &end);
+        if (item.empty() || *end != '\0') return vector<float>();
+        values.push_back(value);
+    }
+    return values;
+}
+
+// Parse one of the options shared by every mode. Returns false (after
+// printing an error) for anything unknown or malformed.
+static bool parseDetectOption(const string& arg, ToolOptions& options) {
+    if (arg.compare(0, 11, "--hint-box=") == 0) {
+        vector<float> values = parseNumberList(arg.substr(11));
+        if (values.size() == 4 && values[2] > 0 && values[3] > 0) {
+            options.hintBox = Rect(cvRound(values[0]), cvRound(values[1]), cvRound(values[2]), cvRound(values[3]));
+            // The last hint given wins; corners would otherwise take
+            // precedence over the box (see hintSearchRegion).
+            options.hintCorners.clear();
+            return true;
+        }
+    }
+    if (arg.compare(0, 15, "--hint-corners=") == 0) {
+        vector<float> values = parseNumberList(arg.substr(15));
+        if (values.size() >= 2 && values.size() % 2 == 0) {
+            options.hintCorners.clear();
+            for (size_t i = 0; i < values.size(); i += 2) {
+                options.hintCorners.push_back(Point2f(values[i], values[i + 1]));
+            }
+            options.hintBox = Rect();
+            return true;
+        }
+    }
+    if (arg.compare(0, 6, "--raw=") == 0) {
+        int width = 0, height = 0, bits = 8;
+        char separator = 0;
+        istringstream spec(arg.substr(6));
+        spec >> width >> separator >> height;
+        if (spec.peek() == ':') {
+            spec.get();
+            spec >> bits;
+        }
+        if (spec && spec.peek() == EOF && separator == 'x' && width > 0 && height > 0 && (bits == 8 || bits == 16)) {
+            options.rawSize = Size(width, height);
+            options.rawBits = bits;
+            return true;
+        }
+    }
+    if (arg.compare(0, 8, "--bytes=") == 0) {
+        long long bytes = atoll(arg.c_str() + 8);
+        if (bytes > 0) {
+            options.inputBytes = (size_t)bytes;
+            return true;
+        }
+    }
+    if (arg == "--pyramid") {
+        options.pyramidMaxSide = 1600;
+        return true;
+    }
+    if (arg.compare(0, 10, "--pyramid=") == 0) {
+        options.pyramidMaxSide = atoi(arg.c_str() + 10);
+        if (options.pyramidMaxSide > 0) return true;
+    }
+    if (arg.compare(0, 9, "--output=") == 0 && parseOutputFormat(arg.substr(9), options.output)) {
+        return true;
+    }
+    writeError(options, "Invalid option " + arg);
+    return false;
+}
+
+// Size of the image bytes that follow a job line when its path is "-": the
+// line's --bytes=<count>, or `serverBytes` (the server's own --bytes) when it
+// has none; 0 for other paths. This only looks at the tokens, so it also
+// works for job lines that fail to parse, whose payload must still be
+// skipped to keep the stream in sync.
+static size_t inlinePayloadSize(const string& line, size_t serverBytes) {
+    istringstream job(line);
+    string rows, cols, token;
+    if (!(job >> rows >> cols)) return 0;
+    long long bytes = (long long)serverBytes;
+    while (job >> token && token.compare(0, 2, "--") == 0) {
+        if (token.compare(0, 8, "--bytes=") == 0) bytes = atoll(token.c_str() + 8);
+    }
+    string rest;
+    getline(job, rest);
+    if (!rest.empty() && rest[rest.size() - 1] == '\r') rest.erase(rest.size() - 1);
+    return token == "-" && rest.find_first_not_of(" \t") == string::npos && bytes > 0 ? (size_t)bytes : 0;
+}
+
+// Parse one option of a server job line into `jobOptions`, a copy of the
+// server's `options`. Responses, option errors included, must keep the
+// encoding the client started the server with, so --output is refused.
+static bool parseJobOption(const string& arg, const ToolOptions& options, ToolOptions& jobOptions) {
+    if (arg.compare(0, 9, "--output=") == 0) {
+        writeError(options, "--output cannot be changed per job");
+        return false;
+    }
+    return parseDetectOption(arg, jobOptions);
+}
+
+// Answer detection jobs from stdin until EOF. Every response is flushed so
+// the caller can match responses to requests in order.
+static int runServer(const ToolOptions& options) {
+    DetectContext context(options);
+    string line;
+    while (getline(cin, line)) {
+        if (line.empty() || line.find_first_not_of(" \t\r") == string::npos) continue;
+        if (line == "quit" || line == "quit\r") break;
+
+        // A job that is rejected below still has its inline image read
+        // and dropped, or the bytes would be taken for job lines.
+        size_t payload = inlinePayloadSize(line, options.inputBytes);
+        istringstream job(line);
+        int rows = 0, cols = 0;
+        string imagePath;
+        if (!(job >> rows >> cols)) {
+            writeError(options, "Invalid job line, expected: <rows> <cols> [options] <image_path>");
+            cin.ignore((streamsize)payload);
+            continue;
+        }
+
+        // Per-job options come before the path, which may itself contain spaces.
+        getline(job >> ws, imagePath);
+        if (!imagePath.empty() && imagePath[imagePath.size() - 1] == '\r') {
+            imagePath.erase(imagePath.size() - 1);
+        }
+        ToolOptions jobOptions = options;
+        bool validOptions = true;
+        while (validOptions && imagePath.compare(0, 2, "--") == 0) {
+            size_t end = imagePath.find_first_of(" \t");
+            validOptions = parseJobOption(imagePath.substr(0, end), options, jobOptions);
+            size_t next = imagePath.find_first_not_of(" \t", end);
+            imagePath = next == string::npos ? string() : imagePath.substr(next);
+        }
+        if (!validOptions) {
+            cin.ignore((streamsize)payload);
+            continue;
+        }
+        if (imagePath.empty()) {
+            writeError(options, "Invalid job line, expected: <rows> <cols> [options] <image_path>");
+            cin.ignore((streamsize)payload);
+            continue;
+        }
+
+        // Image bytes sent inline follow the job line directly.
+        context.state.input.clear();
+        if (imagePath == "-") {
+            if (jobOptions.inputBytes == 0) {
+                // Neither the job nor the server gave a size, so the client
+                // cannot have framed a payload either; there is none to skip.
+                writeError(options, "Images sent on stdin need --bytes=<count>");
+                continue;
+            }
+            context.state.input.resize(jobOptions.inputBytes);
+            if (!cin.read((char*)context.state.input.data(), context.state.input.size())) break;
+        }
+
+        // A bad image must not take the resident process down with it.
+        try {
+            detectImage(imagePath, rows, cols, jobOptions, context, *context.out);
+        } catch (cv::Exception& e) {
+            context.out->clear();
+            writeFailure(*context.out, imagePath, false, string("OpenCV Detection Error: ") + e.what());
+        }
+        context.out->flush();
+    }
+    return 0;
+}
+
+static bool hasImageExtension(const string& path) {
+    static const char* extensions[] = {
+        ".jpg", ".jpeg", ".png", ".bmp", ".tif", ".tiff", ".pgm", ".ppm", ".pnm", ".webp"
+    };
+    size_t dot = path.find_last_of('.');
+    if (dot == string::npos) return false;
+    string ext = path.substr(dot);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    for (size_t i = 0; i < sizeof(extensions) / sizeof(extensions[0]); i++) {
+        if (ext == extensions[i]) return true;
+    }
+    return false;
+}
+
+// Expand a batch source (list file, directory or glob pattern) into image paths.
+static bool collectImages(const string& source, vector<string>& images, string& error) {
+    struct stat info;
+    bool isPattern = source.find_first_of("*?") != string::npos;
+
+    if (!isPattern && stat(source.c_str(), &info) != 0) {
+        error = "Could not access batch source " + source;
+        return false;
+    }
+
+    if (isPattern || S_ISDIR(info.st_mode)) {
+        vector<String> matches;
+        glob(source, matches, false);
+        for (size_t i = 0; i < matches.size(); i++) {
+            // A directory holds arbitrary files; an explicit pattern is trusted as-is.
+            if (isPattern || hasImageExtension(matches[i])) images.push_back(matches[i]);
+        }
+        std::sort(images.begin(), images.end());
+        return true;
+    }
+
+    ifstream list(source);
+    if (!list.is_open()) {
+        error = "Could not open image list " + source;
+        return false;
+    }
+    string line;
+    while (getline(list, line)) {
+        size_t first = line.find_first_not_of(" \t");
+        size_t last = line.find_last_not_of(" \t\r");
+        if (first == string::npos || line[first] == '#') continue;
+        images.push_back(line.substr(first, last - first + 1));
+    }
+    return true;
+}
+
+// Collects finished batch records and prints them, either in input order or
+// as soon as they are done.
+class ResultSink {
+public:
+    ResultSink(size_t count, bool ordered)
+        : results_(ordered ? count : 0), ready_(ordered ? count : 0, false),
+          ordered_(ordered), nextToPrint_(0) {}
+
+    void submit(size_t index, const string& record) {
+        lock_guard<mutex> lock(mutex_);
+        if (!ordered_) {
+            writeFully(STDOUT_FILENO, record.data(), record.size());
+            return;
+        }
+        results_[index] = record;
+        ready_[index] = true;
+        // Print the longest finished prefix so output streams while workers
+        // run, gathering it into one write.
+        while (nextToPrint_ < results_.size() && ready_[nextToPrint_]) {
+            pending_ += results_[nextToPrint_];
+            string().swap(results_[nextToPrint_]);
+            nextToPrint_++;
+        }
+        writeFully(STDOUT_FILENO, pending_.data(), pending_.size());
+        pending_.clear();
+    }
+
+private:
+    vector<string> results_;
+    string pending_;
+    vector<bool> ready_;
+    bool ordered_;
+    size_t nextToPrint_;
+    mutex mutex_;
+};
+
+// Detect every image of a batch source in this process, one JSON line each.
+// Workers pull the next unclaimed image from a shared queue, so slow images
+// do not hold up the others.
+static int runBatch(const string& source, int rows, int cols, const ToolOptions& options,
+                    int threads, bool ordered) {
+    vector<string> images;
+    string error;
+    if (!collectImages(source, images, error)) {
+        writeError(options, error);
         return 1;
     }
 
-    string imagePath = argv[1];
-    int rows = 0, cols = 0;
-    
+    if (threads <= 0) threads = getNumberOfCPUs();
+    threads = std::max(1, std::min<int>(threads, (int)images.size()));
+    // Parallelism comes from the workers; nested OpenCV threading would only
+    // oversubscribe the cores.
+    if (threads > 1) setNumThreads(1);
+
+    ResultSink sink(images.size(), ordered);
+    atomic<size_t> nextImage(0);
+
+    auto worker = [&]() {
+        DetectContext context(options);
+        size_t i;
+        while ((i = nextImage++) < images.size()) {
+            ResultWriter& record = *context.out;
+            record.clear();
+            try {
+                detectImage(images[i], rows, cols, options, context, record, true);
+            } catch (cv::Exception& e) {
+                record.clear();
+                writeFailure(record, images[i], true, string("OpenCV Detection Error: ") + e.what());
+            }
+            sink.submit(i, record.str());
+        }
+    };
+
+    vector<thread> pool;
+    for (int t = 1; t < threads; t++) pool.push_back(thread(worker));
+    worker();
+    for (size_t t = 0; t < pool.size(); t++) pool[t].join();
+    return 0;
+}
+
+static bool parseBoardSize(const char* rowsArg, const char* colsArg, const ToolOptions& options,
+                           int& rows, int& cols) {
     try {
-        rows = stoi(argv[2]);
-        cols = stoi(argv[3]);
+        rows = stoi(rowsArg);
+        cols = stoi(colsArg);
     } catch (...) {
-        cout << "{\"error\": \"Invalid rows/cols arguments\"}" << endl;
-        return 1;
+        writeError(options, "Invalid rows/cols arguments");
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    ToolOptions options;
+
+    // The encoding applies to every message, including argument errors, so
+    // pick it up before anything else is parsed.
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg.compare(0, 9, "--output=") == 0) parseOutputFormat(arg.substr(9), options.output);
     }
+    string mode = argc >= 2 ? argv[1] : "";
+    options.framed = mode == "--server" || mode == "--batch";
 
-    Mat img = imread(imagePath);
-    if (img.empty()) {
-        cout << "{\"error\": \"Could not read image at " << imagePath << "\"}" << endl;
-        return 0;
+    if (mode == "--server") {
+        for (int i = 2; i < argc; i++) {
+            if (!parseDetectOption(argv[i], options)) return 1;
+        }
+        return runServer(options);
     }
 
-    Mat gray;
-    cvtColor(img, gray, COLOR_BGR2GRAY);
+    int rows = 0, cols = 0;
 
-    vector<Size> sizesToTry;
-    
-    if (rows > 0 && cols > 0) {
-        // 1. As provided
-        sizesToTry.push_back(Size(cols, rows));
-        sizesToTry.push_back(Size(rows, cols));
-        
-        // 2. As squares (user entered squares, so we need squares-1)
-        if (cols > 1 && rows > 1) {
-            sizesToTry.push_back(Size(cols - 1, rows - 1));
-            sizesToTry.push_back(Size(rows - 1, cols - 1));
+    if (mode == "--batch") {
+        if (argc < 5) {
+            writeError(options, "Usage: ./detect_corners --batch <list_file|directory|glob> <rows> <cols> [--threads N] [--unordered]");
+            return 1;
         }
-    } else {
-        // Auto-detect mode
-        
-        // 1. Estimate number of corners using goodFeaturesToTrack
-        // This helps us set an upper bound on the board size
-        vector<Point2f> features;
-        // maxCorners=0 (unlimited), quality=0.01, minDistance=10
-        goodFeaturesToTrack(gray, features, 0, 0.01, 10);
-        int detectedCount = features.size();
-        
-        // cout << "Detected features: " << detectedCount << endl; // Debug
-        
-        // 2. Generate candidates
-        // Range: 3x3 to 20x20 (covers most boards)
-        // We also want to support rectangular boards
-        for (int r = 3; r <= 20; r++) {
-            for (int c = 3; c <= 20; c++) {
-                // Heuristic: The board cannot have more corners than we detected features
-                // (with some margin for error/occlusion/noise vs missed features)
-                // Actually, goodFeatures usually finds MORE than just the inner corners (outer corners, noise).
-                // So if Area > detectedCount, it's very unlikely to be the board.
-                // We add a small margin just in case.
-                if (r * c <= detectedCount + 20) {
-                    sizesToTry.push_back(Size(c, r));
-                }
+        if (!parseBoardSize(argv[3], argv[4], options, rows, cols)) return 1;
+
+        int threads = 0;
+        bool ordered = true;
+        for (int i = 5; i < argc; i++) {
+            string arg = argv[i];
+            if (arg == "--unordered") {
+                ordered = false;
+            } else if (arg == "--threads" && i + 1 < argc) {
+                threads = atoi(argv[++i]);
+            } else if (!parseDetectOption(arg, options)) {
+                return 1;
             }
         }
-        
-        // 3. Sort by Area Descending
-        // This ensures we find the LARGEST valid board first, preventing
-        // finding a sub-grid (e.g. 5x5 inside a 8x8).
-        std::sort(sizesToTry.begin(), sizesToTry.end(), [](const Size& a, const Size& b) {
-            return (a.width * a.height) > (b.width * b.height);
-        });
-        
-        // 4. Remove duplicates (optional but good)
-        // (Not strictly necessary if loop order was unique pairs, but r,c and c,r can be dupes if square)
-    }
-
-    // Flags: Adaptive threshold + Normalize + Fast Check
-    int flags = CALIB_CB_ADAPTIVE_THRESH | CALIB_CB_NORMALIZE_IMAGE | CALIB_CB_FAST_CHECK;
-    
-    bool found = false;
-    Size foundSize;
-    vector<Point2f> corners;
-
-    for (const auto& size : sizesToTry) {
-        // Clear previous attempts
-        corners.clear();
-        
-        // Use standard findChessboardCorners with Fast Check
-        found = findChessboardCorners(gray, size, corners, flags);
-        
-        if (found) {
-            foundSize = size;
-            break;
-        }
-    }
-
-    if (found) {
-        // Refine corner locations
-        cornerSubPix(gray, corners, Size(11, 11), Size(-1, -1),
-            TermCriteria(TermCriteria::EPS + TermCriteria::COUNT, 30, 0.1));
-
-        // Draw corners (optional, for debug image saving, but we just need JSON now)
-        // drawChessboardCorners(img, foundSize, Mat(corners), found);
-
-        cout << "{";
-        cout << "\"success\": true,";
-        cout << "\"rows\": " << foundSize.height << ",";
-        cout << "\"cols\": " << foundSize.width << ",";
-        cout << "\"width\": " << img.cols << ",";
-        cout << "\"height\": " << img.rows << ",";
-        cout << "\"corners\": [";
-        for (size_t i = 0; i < corners.size(); i++) {
-            cout << "{\"x\": " << corners[i].x << ", \"y\": " << corners[i].y << "}";
-            if (i < corners.size() - 1) cout << ",";
-        }
-        cout << "]";
-        cout << "}" << endl;
-    } else {
-        if (rows > 0) {
-             cout << "{\"success\": false, \"error\": \"Chessboard pattern not found. Tried " 
-                  << cols << "x" << rows << " and " << (cols-1) << "x" << (rows-1) << "\"}" << endl;
-        } else {
-             cout << "{\"success\": false, \"error\": \"Auto-detection failed. Could not find any valid chessboard pattern.\"}" << endl;
-        }
+        return runBatch(argv[2], rows, cols, options, threads, ordered);
+    }
+
+    // Expected args: <image_path> <rows> <cols> [options]
+    if (argc < 4) {
+        writeError(options, "Usage: ./detect_corners <image_path> <rows> <cols> | ./detect_corners --server | ./detect_corners --batch <source> <rows> <cols>");
+        return 1;
+    }
+
+    string imagePath = argv[1];
+    if (!parseBoardSize(argv[2], argv[3], options, rows, cols)) return 1;
+    for (int i = 4; i < argc; i++) {
+        if (!parseDetectOption(argv[i], options)) return 1;
     }
 
+    DetectContext context(options);
+    detectImage(imagePath, rows, cols, options, context, *context.out);
+    context.out->flush();
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,663 @@
+#include "detection.h"
+
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <set>
+#include <map>
+#include <iterator>
+#include <limits>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Images are always decoded straight to 8-bit grayscale. In pyramid mode a
+// JPEG is decoded at reduced resolution for the search, and at full
+// resolution only once a board has been found there.
+
+using namespace cv;
+using namespace std;
+
+// Shrink [low, high] from both ends while the per-line counts stay below half
+// of the fullest line.
+static void trimSparseEnds(const map<int, int>& counts, int& low, int& high) {
+    int fullest = 0;
+    for (map<int, int>::const_iterator it = counts.begin(); it != counts.end(); ++it) {
+        fullest = std::max(fullest, it->second);
+    }
+    map<int, int>::const_iterator first = counts.begin();
+    map<int, int>::const_reverse_iterator last = counts.rbegin();
+    while (2 * first->second < fullest) ++first;
+    while (2 * last->second < fullest) ++last;
+    low = first->first;
+    high = last->first;
+}
+
+// Propose board sizes (largest first) by arranging goodFeaturesToTrack
+// responses into a lattice, instead of brute-forcing every size:
+//   1. vote on the directions to each feature's nearest neighbours to find
+//      the two lattice axes (modulo 180 degrees),
+//   2. link each feature to its nearest neighbour along +/- each axis,
+//   3. walk mutual links to give features integer grid coordinates,
+//   4. take the extent of the largest, mostly filled grid.
+// goodFeaturesToTrack also fires on the corners where the outer squares meet
+// the white margin, so the grid minus its border is proposed as well.
+// Returns nothing when no clear lattice emerges.
+static vector<Size> inferBoardSizes(const vector<Point2f>& features) {
+    vector<Size> proposals;
+    const int n = (int)features.size();
+    const int kNeighbors = 8;
+    // Brute-force neighbour search; beyond this the image is mostly texture anyway.
+    if (n < 9 || n > 5000) return proposals;
+
+    // Nearest neighbours of every feature, closest first
+    vector<vector<int> > neighbors(n);
+    vector<pair<float, int> > distances;
+    for (int i = 0; i < n; i++) {
+        distances.clear();
+        for (int j = 0; j < n; j++) {
+            if (j == i) continue;
+            Point2f d = features[j] - features[i];
+            distances.push_back(make_pair(d.dot(d), j));
+        }
+        int k = std::min(kNeighbors, (int)distances.size());
+        std::partial_sort(distances.begin(), distances.begin() + k, distances.end());
+        for (int m = 0; m < k; m++) neighbors[i].push_back(distances[m].second);
+    }
+
+    // 1. Vote for the two dominant neighbour directions (5 degree bins)
+    const int bins = 36;
+    vector<double> votes(bins, 0.0);
+    for (int i = 0; i < n; i++) {
+        for (size_t m = 0; m < neighbors[i].size() && m < 4; m++) {
+            Point2f d = features[neighbors[i][m]] - features[i];
+            double angle = atan2(d.y, d.x);
+            if (angle < 0) angle += CV_PI;
+            votes[std::min(bins - 1, (int)(angle / CV_PI * bins))] += 1.0;
+        }
+    }
+    vector<double> smoothed(bins);
+    for (int b = 0; b < bins; b++) {
+        smoothed[b] = votes[(b + bins - 1) % bins] + 2 * votes[b] + votes[(b + 1) % bins];
+    }
+    int first = (int)(std::max_element(smoothed.begin(), smoothed.end()) - smoothed.begin());
+    int second = -1;
+    for (int b = 0; b < bins; b++) {
+        int separation = std::abs(b - first);
+        separation = std::min(separation, bins - separation);
+        // The second axis must be at least 30 degrees away from the first
+        if (separation >= 6 && (second < 0 || smoothed[b] > smoothed[second])) second = b;
+    }
+    if (second < 0 || smoothed[second] < 0.25 * smoothed[first]) return proposals;
+
+    Point2f axes[2];
+    int axisBins[2] = { first, second };
+    for (int a = 0; a < 2; a++) {
+        double angle = (axisBins[a] + 0.5) * CV_PI / bins;
+        axes[a] = Point2f((float)cos(angle), (float)sin(angle));
+    }
+
+    // 2. Link each feature to its nearest neighbour along +axis0, -axis0, +axis1, -axis1.
+    // A link may not be much longer than the nearest-neighbour spacing at
+    // either end, which keeps stray features from attaching to the grid.
+    const float cosTolerance = 0.92f; // about 23 degrees, enough for moderate perspective
+    const float maxSpacingRatio = 1.8f;
+    vector<float> spacing(n);
+    for (int i = 0; i < n; i++) {
+        Point2f d = features[neighbors[i][0]] - features[i];
+        spacing[i] = sqrt(d.dot(d));
+    }
+    vector<int> links(4 * n, -1);
+    for (int i = 0; i < n; i++) {
+        for (size_t m = 0; m < neighbors[i].size(); m++) {
+            int j = neighbors[i][m];
+            Point2f d = features[j] - features[i];
+            float length = sqrt(d.dot(d));
+            if (length <= 0 || length > maxSpacingRatio * std::min(spacing[i], spacing[j])) continue;
+            for (int a = 0; a < 2; a++) {
+                float c = d.dot(axes[a]) / length;
+                if (c > cosTolerance && links[4 * i + 2 * a] < 0) links[4 * i + 2 * a] = j;
+                if (c < -cosTolerance && links[4 * i + 2 * a + 1] < 0) links[4 * i + 2 * a + 1] = j;
+            }
+        }
+    }
+
+    // 3. Walk mutual links, giving every reached feature grid coordinates
+    const int stepI[4] = { 1, -1, 0, 0 };
+    const int stepJ[4] = { 0, 0, 1, -1 };
+    vector<int> gridI(n, 0), gridJ(n, 0);
+    vector<bool> visited(n, false);
+    int bestW = 0, bestH = 0;
+    int bestCells = 0;
+    for (int start = 0; start < n; start++) {
+        if (visited[start]) continue;
+        visited[start] = true;
+        vector<int> queue(1, start);
+        set<pair<int, int> > cells;
+        cells.insert(make_pair(0, 0));
+        for (size_t q = 0; q < queue.size(); q++) {
+            int u = queue[q];
+            for (int d = 0; d < 4; d++) {
+                int v = links[4 * u + d];
+                // d ^ 1 is the opposite direction
+                if (v < 0 || visited[v] || links[4 * v + (d ^ 1)] != u) continue;
+                visited[v] = true;
+                gridI[v] = gridI[u] + stepI[d];
+                gridJ[v] = gridJ[u] + stepJ[d];
+                cells.insert(make_pair(gridI[v], gridJ[v]));
+                queue.push_back(v);
+            }
+        }
+        if ((int)cells.size() < 9) continue;
+
+        // Stray features that still attached to the grid form sparse outer
+        // rows/columns; trim those that hold less than half of the fullest one.
+        map<int, int> perI, perJ;
+        for (set<pair<int, int> >::const_iterator it = cells.begin(); it != cells.end(); ++it) {
+            perI[it->first]++;
+            perJ[it->second]++;
+        }
+        int lowI, highI, lowJ, highJ;
+        trimSparseEnds(perI, lowI, highI);
+        trimSparseEnds(perJ, lowJ, highJ);
+
+        int inside = 0;
+        for (set<pair<int, int> >::const_iterator it = cells.begin(); it != cells.end(); ++it) {
+            if (it->first >= lowI && it->first <= highI && it->second >= lowJ && it->second <= highJ) inside++;
+        }
+        if (inside > bestCells) {
+            bestCells = inside;
+            bestW = highI - lowI + 1;
+            bestH = highJ - lowJ + 1;
+        }
+    }
+
+    // 4. A real board fills most of its bounding grid
+    if (bestW < 3 || bestH < 3 || bestCells < 0.7 * bestW * bestH) return proposals;
+
+    proposals.push_back(Size(bestW, bestH));
+    if (bestW - 2 >= 3 && bestH - 2 >= 3) proposals.push_back(Size(bestW - 2, bestH - 2));
+    return proposals;
+}
+
+// Return the first candidate size (in `sizesToTry` order) for which a board is
+// found. In parallel mode the candidates are spread over OpenCV's thread pool;
+// once a candidate succeeds, every later candidate that has not started yet
+// is skipped, and earlier ones still run to completion. The lowest successful
+// index therefore wins, exactly as in the sequential loop.
+static bool findFirstBoard(const Mat& gray, const vector<Size>& sizesToTry, int flags, bool parallel,
+                           Size& foundSize, vector<Point2f>& corners) {
+    corners.clear();
+
+    if (!parallel) {
+        for (const auto& size : sizesToTry) {
+            // Clear previous attempts
+            corners.clear();
+
+            // Use standard findChessboardCorners with Fast Check
+            if (findChessboardCorners(gray, size, corners, flags)) {
+                foundSize = size;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const int count = (int)sizesToTry.size();
+    atomic<int> best(count);
+    vector<vector<Point2f> > candidateCorners(count);
+
+    parallel_for_(Range(0, count), [&](const Range& range) {
+        for (int i = range.start; i < range.end; i++) {
+            // An earlier (larger) candidate already matched.
+            if (i >= best.load()) return;
+
+            if (findChessboardCorners(gray, sizesToTry[i], candidateCorners[i], flags)) {
+                int current = best.load();
+                while (i < current && !best.compare_exchange_weak(current, i)) {}
+            }
+        }
+    }, count);
+
+    if (best.load() == count) return false;
+    foundSize = sizesToTry[best];
+    corners.swap(candidateCorners[best]);
+    return true;
+}
+
+// Inferred sizes come from a lattice whose sparse ends were trimmed, so a hit
+// can be an inner sub-grid of the real board, which findChessboardCorners
+// accepts just as well. Keep adding a row and/or a column while the larger
+// board is still found, so the largest valid board wins as in the
+// area-ordered sweep.
+static void growInferredBoard(const Mat& gray, int flags, Size& foundSize, vector<Point2f>& corners) {
+    vector<Point2f> larger;
+    for (bool grown = true; grown;) {
+        grown = false;
+        const Size probes[3] = { Size(foundSize.width + 1, foundSize.height + 1),
+                                 Size(foundSize.width + 1, foundSize.height),
+                                 Size(foundSize.width, foundSize.height + 1) };
+        for (int i = 0; i < 3 && !grown; i++) {
+            larger.clear();
+            if (findChessboardCorners(gray, probes[i], larger, flags)) {
+                foundSize = probes[i];
+                corners.swap(larger);
+                grown = true;
+            }
+        }
+    }
+}
+
+// Map corners found on a downscaled image back to the full-resolution one.
+static void scaleCorners(vector<Point2f>& corners, Size from, Size to) {
+    float sx = (float)to.width / from.width;
+    float sy = (float)to.height / from.height;
+    for (size_t i = 0; i < corners.size(); i++) {
+        // Pixel centres: downscaled pixel x covers full pixels [x * sx, (x + 1) * sx)
+        corners[i].x = (corners[i].x + 0.5f) * sx - 0.5f;
+        corners[i].y = (corners[i].y + 0.5f) * sy - 0.5f;
+    }
+}
+
+// cornerSubPix window for corners that were found `scale` times smaller than
+// the image they are refined in. The window must cover the coarse
+// localisation error (about one coarse pixel) while staying inside a single
+// board square.
+static Size refineWindow(const vector<Point2f>& corners, Size boardSize, float scale) {
+    if (scale <= 1.0f) return Size(11, 11);
+
+    // Shortest distance between neighbouring corners at full resolution
+    float spacing = std::numeric_limits<float>::max();
+    for (int r = 0; r < boardSize.height; r++) {
+        for (int c = 0; c < boardSize.width; c++) {
+            const Point2f& p = corners[r * boardSize.width + c];
+            if (c + 1 < boardSize.width) spacing = std::min(spacing, (float)norm(corners[r * boardSize.width + c + 1] - p));
+            if (r + 1 < boardSize.height) spacing = std::min(spacing, (float)norm(corners[(r + 1) * boardSize.width + c] - p));
+        }
+    }
+
+    int half = std::max(11, cvCeil(2 * scale));
+    half = std::min(half, std::max(5, cvFloor(0.45f * spacing)));
+    return Size(half, half);
+}
+
+// Search `region` for the board and return its corners in region pixel
+// coordinates. Pyramid mode searches a downscaled copy and maps the corners
+// back up; `scale` reports how much coarser than `region` they were found.
+static bool searchBoard(const Mat& region, int rows, int cols, const DetectOptions& options,
+                        DetectorState& state, Size& foundSize, vector<Point2f>& corners, float& scale) {
+    const Mat* search = &region;
+    int longestSide = std::max(region.cols, region.rows);
+    if (options.pyramidMaxSide > 0 && longestSide > options.pyramidMaxSide) {
+        double shrink = (double)options.pyramidMaxSide / longestSide;
+        Size coarseSize(std::max(1, cvRound(region.cols * shrink)), std::max(1, cvRound(region.rows * shrink)));
+        resize(region, state.coarse, coarseSize, 0, 0, INTER_AREA);
+        search = &state.coarse;
+    }
+    int hintCount = (int)options.hintCorners.size();
+
+    vector<Size> sizesToTry;
+    vector<Size> inferredSizes;
+    
+    if (rows > 0 && cols > 0) {
+        // 1. As provided
+        sizesToTry.push_back(Size(cols, rows));
+        sizesToTry.push_back(Size(rows, cols));
+        
+        // 2. As squares (user entered squares, so we need squares-1)
+        if (cols > 1 && rows > 1) {
+            sizesToTry.push_back(Size(cols - 1, rows - 1));
+            sizesToTry.push_back(Size(rows - 1, cols - 1));
+        }
+    } else {
+        // Auto-detect mode
+        
+        // 1. Estimate number of corners using goodFeaturesToTrack
+        // This helps us set an upper bound on the board size
+        vector<Point2f>& features = state.features;
+        // maxCorners=0 (unlimited), quality=0.01, minDistance=10
+        goodFeaturesToTrack(*search, features, 0, 0.01, 10);
+        int detectedCount = features.size();
+
+        // 2. Infer the grid directly from how the features are arranged.
+        // When this works the board is found in one or two detector passes.
+        inferredSizes = inferBoardSizes(features);
+
+        // 3. Generate fallback candidates for when inference fails
+        // Range: 3x3 to 20x20 (covers most boards)
+        // We also want to support rectangular boards
+        for (int r = 3; r <= 20; r++) {
+            for (int c = 3; c <= 20; c++) {
+                // Heuristic: The board cannot have more corners than we detected features
+                // (with some margin for error/occlusion/noise vs missed features)
+                // Actually, goodFeatures usually finds MORE than just the inner corners (outer corners, noise).
+                // So if Area > detectedCount, it's very unlikely to be the board.
+                // We add a small margin just in case.
+                if (r * c <= detectedCount + 20 &&
+                    std::find(inferredSizes.begin(), inferredSizes.end(), Size(c, r)) == inferredSizes.end()) {
+                    sizesToTry.push_back(Size(c, r));
+                }
+            }
+        }
+        
+        // 4. Sort by Area Descending
+        // This ensures we find the LARGEST valid board first, preventing
+        // finding a sub-grid (e.g. 5x5 inside a 8x8).
+        std::sort(sizesToTry.begin(), sizesToTry.end(), [](const Size& a, const Size& b) {
+            return (a.width * a.height) > (b.width * b.height);
+        });
+        
+        // 5. Remove duplicates (optional but good)
+        // (Not strictly necessary if loop order was unique pairs, but r,c and c,r can be dupes if square)
+    }
+
+    // A previous-frame corner set tells us the corner count: try sizes with
+    // that area first, keeping the relative order otherwise.
+    if (hintCount > 0) {
+        auto matchesHint = [hintCount](const Size& size) { return size.area() == hintCount; };
+        std::stable_partition(inferredSizes.begin(), inferredSizes.end(), matchesHint);
+        std::stable_partition(sizesToTry.begin(), sizesToTry.end(), matchesHint);
+    }
+
+    // Flags: Adaptive threshold + Normalize + Fast Check
+    int flags = CALIB_CB_ADAPTIVE_THRESH | CALIB_CB_NORMALIZE_IMAGE | CALIB_CB_FAST_CHECK;
+
+    // The explicit mode has at most four candidates and the first one usually
+    // matches, so only the auto-detect sweep is worth spreading over cores.
+    bool autoDetect = !(rows > 0 && cols > 0);
+    bool found = findFirstBoard(*search, inferredSizes, flags, false, foundSize, corners);
+    if (found) {
+        growInferredBoard(*search, flags, foundSize, corners);
+    } else {
+        found = findFirstBoard(*search, sizesToTry, flags, autoDetect, foundSize, corners);
+    }
+
+    scale = (float)region.cols / search->cols;
+    if (found && search != &region) {
+        scaleCorners(corners, search->size(), region.size());
+    }
+    return found;
+}
+
+// Region to search when a hint is given: the hint box (or the bounding box of
+// the hint corners) grown by half its size on every side, clipped to the image.
+// Hints are in full-resolution pixels; `reduction` maps them onto a reduced decode.
+static Rect hintSearchRegion(const DetectOptions& options, Size imageSize, int reduction) {
+    Rect box = options.hintBox;
+    if (!options.hintCorners.empty()) box = boundingRect(options.hintCorners);
+    if (box.width <= 0 || box.height <= 0) return Rect();
+    box = Rect(box.x / reduction, box.y / reduction,
+               std::max(1, box.width / reduction), std::max(1, box.height / reduction));
+
+    int marginX = box.width / 2 + 16;
+    int marginY = box.height / 2 + 16;
+    Rect grown(box.x - marginX, box.y - marginY, box.width + 2 * marginX, box.height + 2 * marginY);
+    return grown & Rect(0, 0, imageSize.width, imageSize.height);
+}
+
+// Read the pixel size from a JPEG header without decoding the image.
+static bool readJpegSize(istream& in, Size& size) {
+    if (in.get() != 0xFF || in.get() != 0xD8) return false;
+    for (;;) {
+        int marker = in.get();
+        if (marker != 0xFF) return false;
+        while (marker == 0xFF) marker = in.get();
+        // End of image or start of scan before any frame header
+        if (marker == EOF || marker == 0xD9 || marker == 0xDA) return false;
+        // Standalone markers carry no length
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) continue;
+
+        unsigned char header[7];
+        if (!in.read((char*)header, 2)) return false;
+        int length = (header[0] << 8) | header[1];
+        // SOF0..SOF15, except DHT (C4), JPG (C8) and DAC (CC)
+        if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            if (!in.read((char*)header, 5)) return false;
+            size = Size((header[3] << 8) | header[4], (header[1] << 8) | header[2]);
+            return size.width > 0 && size.height > 0;
+        }
+        in.ignore(length - 2);
+    }
+}
+
+// Read-only stream over bytes that are already in memory.
+class MemoryStreamBuf : public streambuf {
+public:
+    MemoryStreamBuf(const unsigned char* data, size_t size) {
+        char* begin = (char*)data;
+        setg(begin, begin, begin + size);
+    }
+};
+
+// Where an image's bytes come from: a file path, or bytes handed over in
+// memory so the caller never has to write a temp file.
+//   "-"           stdin (already read into the caller's buffer in server mode)
+//   "shm:<name>"  a POSIX shared memory segment, mapped read-only
+//   "fd:<n>"      an inherited file descriptor such as a memfd, mapped read-only
+// Anything else is a file path. With DetectOptions::inputBytes set, only that
+// many bytes of the segment or descriptor are used.
+class ImageSource {
+public:
+    ImageSource() : data_(NULL), size_(0), mapping_(NULL), mappingSize_(0) {}
+    ~ImageSource() {
+        if (mapping_) munmap(mapping_, mappingSize_);
+    }
+
+    void openMemory(const unsigned char* data, size_t size) {
+        data_ = data;
+        size_ = size;
+    }
+
+    bool open(const string& source, size_t inputBytes, vector<unsigned char>& stdinBuffer) {
+        if (source == "-") {
+            if (stdinBuffer.empty()) {
+                stdinBuffer.assign(istreambuf_iterator<char>(cin), istreambuf_iterator<char>());
+            }
+            data_ = stdinBuffer.data();
+            size_ = stdinBuffer.size();
+            return size_ > 0;
+        }
+        if (source.compare(0, 4, "shm:") == 0) {
+            int fd = shm_open(source.c_str() + 4, O_RDONLY, 0);
+            if (fd < 0) return false;
+            bool mapped = map(fd, inputBytes);
+            close(fd);
+            return mapped;
+        }
+        if (source.compare(0, 3, "fd:") == 0) {
+            // A malformed number must not fall back to descriptor 0 (stdin).
+            const char* digits = source.c_str() + 3;
+            char* end = NULL;
+            errno = 0;
+            long fd = strtol(digits, &end, 10);
+            if (end == digits || *end != '\0' || errno != 0 || fd < 0 || fd > INT_MAX) return false;
+            // The descriptor belongs to the caller, so it is left open.
+            return map((int)fd, inputBytes);
+        }
+        path_ = source;
+        return true;
+    }
+
+    bool inMemory() const { return data_ != NULL; }
+
+    Mat decode(int flags) const {
+        if (!inMemory()) return imread(path_, flags);
+        return imdecode(Mat(1, (int)size_, CV_8UC1, (void*)data_), flags);
+    }
+
+    bool jpegSize(Size& size) const {
+        if (!inMemory()) {
+            ifstream file(path_.c_str(), ios::binary);
+            return readJpegSize(file, size);
+        }
+        MemoryStreamBuf buffer(data_, size_);
+        istream in(&buffer);
+        return readJpegSize(in, size);
+    }
+
+    // At least `count` raw bytes, read from the file into `scratch` if needed.
+    const unsigned char* rawBytes(size_t count, vector<unsigned char>& scratch) const {
+        if (inMemory()) return size_ >= count ? data_ : NULL;
+        ifstream file(path_.c_str(), ios::binary);
+        scratch.resize(count);
+        return file.read((char*)scratch.data(), count) ? scratch.data() : NULL;
+    }
+
+private:
+    ImageSource(const ImageSource&);
+    ImageSource& operator=(const ImageSource&);
+
+    bool map(int fd, size_t inputBytes) {
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0 || info.st_size <= 0) return false;
+        mappingSize_ = (size_t)info.st_size;
+        if (inputBytes > 0 && inputBytes < mappingSize_) mappingSize_ = inputBytes;
+        mapping_ = mmap(NULL, mappingSize_, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapping_ == MAP_FAILED) {
+            mapping_ = NULL;
+            return false;
+        }
+        data_ = (const unsigned char*)mapping_;
+        size_ = mappingSize_;
+        return true;
+    }
+
+    string path_;
+    const unsigned char* data_;
+    size_t size_;
+    void* mapping_;
+    size_t mappingSize_;
+};
+
+// Load a headerless 8-bit or 16-bit mono frame. 16-bit frames (often 10-12
+// significant bits) are scaled so their brightest pixel maps to 255.
+static bool loadRawGray(const ImageSource& source, const DetectOptions& options, DetectorState& state) {
+    int bytesPerPixel = options.rawBits > 8 ? 2 : 1;
+    size_t expected = (size_t)options.rawSize.area() * bytesPerPixel;
+    const unsigned char* pixels = source.rawBytes(expected, state.raw);
+    if (!pixels) return false;
+
+    if (bytesPerPixel == 1) {
+        Mat(options.rawSize, CV_8UC1, (void*)pixels).copyTo(state.gray);
+    } else {
+        Mat raw16(options.rawSize, CV_16UC1, (void*)pixels);
+        double maxValue = 0;
+        minMaxLoc(raw16, NULL, &maxValue);
+        raw16.convertTo(state.gray, CV_8U, maxValue > 0 ? 255.0 / maxValue : 1.0);
+    }
+    return true;
+}
+
+// Decode the image straight to 8-bit grayscale into state.gray, never going
+// through a 3-channel buffer. In pyramid mode a JPEG is decoded at 1/2, 1/4
+// or 1/8 scale (DCT scaling in the decoder) when that still leaves at least
+// pyramidMaxSide pixels; `reduction` reports the factor used. `fullSize` is
+// always the image's native size.
+static bool loadGray(const ImageSource& source, const DetectOptions& options, DetectorState& state,
+                     Size& fullSize, int& reduction) {
+    reduction = 1;
+    if (options.rawBits > 0) {
+        fullSize = options.rawSize;
+        return loadRawGray(source, options, state);
+    }
+
+    Size jpegSize;
+    if (options.pyramidMaxSide > 0 && source.jpegSize(jpegSize)) {
+        static const int reducedFlags[] = { IMREAD_REDUCED_GRAYSCALE_8, IMREAD_REDUCED_GRAYSCALE_4, IMREAD_REDUCED_GRAYSCALE_2 };
+        int longestSide = std::max(jpegSize.width, jpegSize.height);
+        for (int i = 0, factor = 8; factor >= 2; i++, factor /= 2) {
+            if (longestSide / factor < options.pyramidMaxSide) continue;
+            state.gray = source.decode(reducedFlags[i]);
+            if (state.gray.empty()) break;
+            // Decoding applies the EXIF orientation, the frame header does not
+            if ((state.gray.cols > state.gray.rows) != (jpegSize.width > jpegSize.height)) {
+                std::swap(jpegSize.width, jpegSize.height);
+            }
+            fullSize = jpegSize;
+            reduction = factor;
+            return true;
+        }
+    }
+
+    state.gray = source.decode(IMREAD_GRAYSCALE);
+    fullSize = state.gray.size();
+    return !state.gray.empty();
+}
+
+void refineCorners(const Mat& gray, Size boardSize, vector<Point2f>& corners, float scale) {
+    cornerSubPix(gray, corners, refineWindow(corners, boardSize, scale), Size(-1, -1),
+        TermCriteria(TermCriteria::EPS + TermCriteria::COUNT, 30, 0.1));
+}
+
+// Load the image from `source` and find, refine and report the board.
+static void detectInSource(const ImageSource& source, int rows, int cols, const DetectOptions& options,
+                           DetectorState& state, DetectionResult& result) {
+    Size& fullSize = result.imageSize;
+    int reduction = 1;
+    result.status = DETECT_UNREADABLE;
+    result.corners.clear();
+    if (!loadGray(source, options, state, fullSize, reduction)) return;
+    Mat& gray = state.gray;
+
+    Size& foundSize = result.boardSize;
+    vector<Point2f>& corners = result.corners;
+    float scale = 1.0f;
+    bool found = false;
+
+    // With a hint from the previous frame, search only around it first and
+    // fall back to the whole frame if the board has moved out of that region.
+    Rect roi = hintSearchRegion(options, gray.size(), reduction);
+    if (roi.area() > 0 && roi.size() != gray.size()) {
+        found = searchBoard(gray(roi), rows, cols, options, state, foundSize, corners, scale);
+        for (size_t i = 0; found && i < corners.size(); i++) {
+            corners[i].x += roi.x;
+            corners[i].y += roi.y;
+        }
+    }
+    if (!found) {
+        found = searchBoard(gray, rows, cols, options, state, foundSize, corners, scale);
+    }
+
+    if (found && reduction > 1) {
+        // Found on a reduced decode: only now pay for the full-resolution one.
+        scaleCorners(corners, gray.size(), fullSize);
+        scale *= (float)fullSize.width / gray.cols;
+        gray = source.decode(IMREAD_GRAYSCALE);
+        if (gray.size() != fullSize) {
+            corners.clear();
+            return;
+        }
+    }
+
+    if (!found) {
+        result.status = DETECT_NOT_FOUND;
+        return;
+    }
+
+    // Refine corner locations
+    refineCorners(gray, foundSize, corners, scale);
+    result.status = DETECT_FOUND;
+}
+
+void detectCorners(const string& source, int rows, int cols, const DetectOptions& options,
+                   DetectorState& state, DetectionResult& result) {
+    ImageSource image;
+    if (!image.open(source, options.inputBytes, state.input)) {
+        result.status = DETECT_UNREADABLE;
+        result.corners.clear();
+        return;
+    }
+    detectInSource(image, rows, cols, options, state, result);
+}
+
+void detectCorners(const unsigned char* data, size_t size, int rows, int cols, const DetectOptions& options,
+                   DetectorState& state, DetectionResult& result) {
+    ImageSource image;
+    image.openMemory(data, size);
+    detectInSource(image, rows, cols, options, state, result);
+}
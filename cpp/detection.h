@@ -0,0 +1,79 @@
+#ifndef DETECTION_H
+#define DETECTION_H
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+// Chessboard corner detection, shared by the detect_corners tool and the
+// calibcore library (see calibcore.h for the C API).
+
+// Detection settings shared by every mode.
+struct DetectOptions {
+    // Longest side of the coarse image searched by the pyramid mode; 0 disables it.
+    int pyramidMaxSide;
+
+    // Where the board was in the previous frame, either as a box or as the
+    // previous corner set; an empty box and no corners means no hint.
+    cv::Rect hintBox;
+    std::vector<cv::Point2f> hintCorners;
+
+    // Headerless mono input straight from an industrial camera: frame size
+    // and bits per pixel (8 or 16, little endian). 0 bits means an encoded image.
+    cv::Size rawSize;
+    int rawBits;
+
+    // Size of the image handed over in memory (see ImageSource); required for
+    // stdin in server mode, where the bytes follow the job line.
+    size_t inputBytes;
+
+    DetectOptions() : pyramidMaxSide(0), rawBits(0), inputBytes(0) {}
+};
+
+// Working buffers kept alive between images when one process handles many
+// of them, so batch and server modes do not reallocate them per image.
+struct DetectorState {
+    std::vector<unsigned char> input;
+    std::vector<unsigned char> raw;
+    cv::Mat gray;
+    cv::Mat coarse;
+    std::vector<cv::Point2f> features;
+};
+
+enum DetectStatus {
+    DETECT_FOUND,
+    DETECT_NOT_FOUND,
+    // The image could not be read or decoded.
+    DETECT_UNREADABLE
+};
+
+struct DetectionResult {
+    DetectStatus status;
+    // Inner corners of the board that was found (width = cols, height = rows).
+    cv::Size boardSize;
+    // Native size of the image; corners are in its pixel coordinates.
+    cv::Size imageSize;
+    // Row-major corners, refined to sub-pixel accuracy.
+    std::vector<cv::Point2f> corners;
+
+    DetectionResult() : status(DETECT_NOT_FOUND) {}
+};
+
+// Detect a rows x cols board (either way round, or one square smaller in
+// case squares were counted); rows or cols <= 0 auto-detects the size.
+// `source` is a file path, "-" (stdin, or state.input when already filled),
+// "shm:<name>" or "fd:<n>"; see ImageSource.
+void detectCorners(const std::string& source, int rows, int cols, const DetectOptions& options,
+                   DetectorState& state, DetectionResult& result);
+
+// The same for an encoded image (or a raw frame, per options.rawBits) that
+// is already in memory.
+void detectCorners(const unsigned char* data, size_t size, int rows, int cols, const DetectOptions& options,
+                   DetectorState& state, DetectionResult& result);
+
+// Refine corners of a `boardSize` grid to sub-pixel accuracy in `gray`.
+// `scale` says how much coarser than `gray` they were located, which widens
+// the search window accordingly.
+void refineCorners(const cv::Mat& gray, cv::Size boardSize, std::vector<cv::Point2f>& corners, float scale = 1.0f);
+
+#endif
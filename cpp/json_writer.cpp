@@ -0,0 +1,173 @@
+#include "json_writer.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// %.{p}g rounds to p significant digits and strips trailing zeros, so any
+// value that has a representation of at most p digits comes out in that
+// shortest form at precision p. A double always round-trips at 17 digits and
+// anything of 15 digits or fewer is recovered by %.15g, which leaves at most
+// three attempts; floats likewise need between 6 and 9 digits.
+int formatShortest(double number, char* out) {
+    int length = 0;
+    for (int precision = 15; precision <= 17; precision++) {
+        length = snprintf(out, 32, "%.*g", precision, number);
+        if (strtod(out, NULL) == number) break;
+    }
+    return length;
+}
+
+int formatShortest(float number, char* out) {
+    int length = 0;
+    for (int precision = 6; precision <= 9; precision++) {
+        length = snprintf(out, 32, "%.*g", precision, (double)number);
+        if (strtof(out, NULL) == number) break;
+    }
+    return length;
+}
+
+JsonWriter::JsonWriter(size_t reserve) : ResultWriter(reserve), afterKey_(false) {}
+
+// Emit the comma that precedes every element but the first of its container.
+void JsonWriter::separate() {
+    if (afterKey_) {
+        afterKey_ = false;
+        return;
+    }
+    if (hasElement_.empty()) return;
+    if (hasElement_.back()) buffer_ += ',';
+    hasElement_.back() = true;
+}
+
+JsonWriter& JsonWriter::beginObject(size_t) {
+    separate();
+    buffer_ += '{';
+    hasElement_.push_back(false);
+    return *this;
+}
+
+JsonWriter& JsonWriter::endObject() {
+    buffer_ += '}';
+    hasElement_.pop_back();
+    return *this;
+}
+
+JsonWriter& JsonWriter::beginArray(size_t) {
+    separate();
+    buffer_ += '[';
+    hasElement_.push_back(false);
+    return *this;
+}
+
+JsonWriter& JsonWriter::endArray() {
+    buffer_ += ']';
+    hasElement_.pop_back();
+    return *this;
+}
+
+JsonWriter& JsonWriter::key(const char* name) {
+    separate();
+    appendString(name, strlen(name));
+    buffer_ += ':';
+    afterKey_ = true;
+    return *this;
+}
+
+void JsonWriter::writeDouble(double number) {
+    if (!std::isfinite(number)) {
+        null();
+        return;
+    }
+    separate();
+    char text[32];
+    buffer_.append(text, formatShortest(number, text));
+}
+
+void JsonWriter::writeFloat(float number) {
+    if (!std::isfinite(number)) {
+        null();
+        return;
+    }
+    separate();
+    char text[32];
+    buffer_.append(text, formatShortest(number, text));
+}
+
+void JsonWriter::writeInteger(long long number) {
+    separate();
+    char text[32];
+    buffer_.append(text, snprintf(text, sizeof(text), "%lld", number));
+}
+
+void JsonWriter::writeUnsigned(unsigned long long number) {
+    separate();
+    char text[32];
+    buffer_.append(text, snprintf(text, sizeof(text), "%llu", number));
+}
+
+void JsonWriter::writeBool(bool flag) {
+    separate();
+    buffer_ += flag ? "true" : "false";
+}
+
+void JsonWriter::writeString(const char* text, size_t length) {
+    separate();
+    appendString(text, length);
+}
+
+JsonWriter& JsonWriter::null() {
+    separate();
+    buffer_ += "null";
+    return *this;
+}
+
+JsonWriter& JsonWriter::points(const float* xy, size_t count) {
+    beginArray(count);
+    for (size_t i = 0; i < count; i++) {
+        beginObject(2);
+        key("x").value(xy[2 * i]);
+        key("y").value(xy[2 * i + 1]);
+        endObject();
+    }
+    return endArray();
+}
+
+JsonWriter& JsonWriter::endRecord() {
+    buffer_ += '\n';
+    return *this;
+}
+
+void JsonWriter::clear() {
+    ResultWriter::clear();
+    hasElement_.clear();
+    afterKey_ = false;
+}
+
+// Quote and escape a string. Line-framed output must stay on one line, so
+// every control character is escaped.
+void JsonWriter::appendString(const char* text, size_t length) {
+    static const char hex[] = "0123456789abcdef";
+    buffer_ += '"';
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)text[i];
+        if (c == '"' || c == '\\') {
+            buffer_ += '\\';
+            buffer_ += (char)c;
+        } else if (c == '\n') {
+            buffer_ += "\\n";
+        } else if (c == '\t') {
+            buffer_ += "\\t";
+        } else if (c == '\r') {
+            buffer_ += "\\r";
+        } else if (c < 0x20) {
+            buffer_ += "\\u00";
+            buffer_ += hex[c >> 4];
+            buffer_ += hex[c & 0xf];
+        } else {
+            buffer_ += (char)c;
+        }
+    }
+    buffer_ += '"';
+}
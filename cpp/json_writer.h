@@ -0,0 +1,51 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include "result_writer.h"
+
+#include <vector>
+
+// JSON encoding of ResultWriter; every record is a single line. Commas
+// between members and elements are inserted automatically, and points()
+// keeps the established [{"x": .., "y": ..}, ..] layout.
+//
+// Floating point values are written with the fewest digits that parse back
+// to the exact same float/double, so results survive a round trip through
+// the JSON text. NaN and infinities are not valid JSON and are written as null.
+class JsonWriter : public ResultWriter {
+public:
+    explicit JsonWriter(size_t reserve = 4096);
+
+    JsonWriter& beginObject(size_t members = 0);
+    JsonWriter& endObject();
+    JsonWriter& beginArray(size_t elements = 0);
+    JsonWriter& endArray();
+    JsonWriter& key(const char* name);
+    JsonWriter& null();
+    JsonWriter& points(const float* xy, size_t count);
+    JsonWriter& endRecord();
+    void clear();
+
+protected:
+    void writeDouble(double number);
+    void writeFloat(float number);
+    void writeInteger(long long number);
+    void writeUnsigned(unsigned long long number);
+    void writeBool(bool flag);
+    void writeString(const char* text, size_t length);
+
+private:
+    void separate();
+    void appendString(const char* text, size_t length);
+
+    // One entry per open object/array: whether it already has an element.
+    std::vector<bool> hasElement_;
+    bool afterKey_;
+};
+
+// Shortest decimal form of `number` that reads back as the same value.
+// Returns the length written to `out`, which needs room for 32 characters.
+int formatShortest(double number, char* out);
+int formatShortest(float number, char* out);
+
+#endif
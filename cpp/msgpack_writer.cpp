@@ -0,0 +1,185 @@
+#include "msgpack_writer.h"
+
+#include <cstring>
+#include <stdint.h>
+
+MsgPackWriter::MsgPackWriter(bool framed, size_t reserve)
+    : ResultWriter(reserve), framed_(framed), depth_(0), recordStart_(0) {}
+
+// Reserve the length prefix when a framed record starts.
+void MsgPackWriter::beginValue() {
+    if (depth_ == 0 && framed_) {
+        recordStart_ = buffer_.size();
+        buffer_.append(4, '\0');
+    }
+}
+
+void MsgPackWriter::bigEndian(unsigned long long value, int bytes) {
+    for (int shift = 8 * (bytes - 1); shift >= 0; shift -= 8) {
+        buffer_ += (char)((value >> shift) & 0xff);
+    }
+}
+
+// Map and array headers: fixmap/fixarray up to 15 entries, then the 16 or
+// 32-bit forms, whose codes follow each other (code16 + 1 is the 32-bit one).
+void MsgPackWriter::header(unsigned char fix, unsigned char code16, size_t count) {
+    if (count < 16) {
+        buffer_ += (char)(fix | count);
+    } else if (count <= 0xffff) {
+        buffer_ += (char)code16;
+        bigEndian(count, 2);
+    } else {
+        buffer_ += (char)(code16 + 1);
+        bigEndian(count, 4);
+    }
+}
+
+MsgPackWriter& MsgPackWriter::beginObject(size_t members) {
+    beginValue();
+    header(0x80, 0xde, members);
+    depth_++;
+    return *this;
+}
+
+MsgPackWriter& MsgPackWriter::endObject() {
+    depth_--;
+    return *this;
+}
+
+MsgPackWriter& MsgPackWriter::beginArray(size_t elements) {
+    beginValue();
+    header(0x90, 0xdc, elements);
+    depth_++;
+    return *this;
+}
+
+MsgPackWriter& MsgPackWriter::endArray() {
+    depth_--;
+    return *this;
+}
+
+MsgPackWriter& MsgPackWriter::key(const char* name) {
+    writeString(name, strlen(name));
+    return *this;
+}
+
+MsgPackWriter& MsgPackWriter::null() {
+    beginValue();
+    buffer_ += (char)0xc0;
+    return *this;
+}
+
+MsgPackWriter& MsgPackWriter::points(const float* xy, size_t count) {
+    beginValue();
+    size_t bytes = count * 2 * sizeof(float);
+    if (bytes <= 0xff) {
+        buffer_ += (char)0xc4;
+        bigEndian(bytes, 1);
+    } else if (bytes <= 0xffff) {
+        buffer_ += (char)0xc5;
+        bigEndian(bytes, 2);
+    } else {
+        buffer_ += (char)0xc6;
+        bigEndian(bytes, 4);
+    }
+    for (size_t i = 0; i < 2 * count; i++) {
+        uint32_t bits;
+        memcpy(&bits, &xy[i], 4);
+        for (int shift = 0; shift < 32; shift += 8) buffer_ += (char)((bits >> shift) & 0xff);
+    }
+    return *this;
+}
+
+MsgPackWriter& MsgPackWriter::endRecord() {
+    if (framed_) {
+        uint32_t length = (uint32_t)(buffer_.size() - recordStart_ - 4);
+        for (int i = 0; i < 4; i++) buffer_[recordStart_ + i] = (char)((length >> (8 * i)) & 0xff);
+    }
+    return *this;
+}
+
+void MsgPackWriter::clear() {
+    ResultWriter::clear();
+    depth_ = 0;
+    recordStart_ = 0;
+}
+
+void MsgPackWriter::writeDouble(double number) {
+    beginValue();
+    uint64_t bits;
+    memcpy(&bits, &number, 8);
+    buffer_ += (char)0xcb;
+    bigEndian(bits, 8);
+}
+
+void MsgPackWriter::writeFloat(float number) {
+    beginValue();
+    uint32_t bits;
+    memcpy(&bits, &number, 4);
+    buffer_ += (char)0xca;
+    bigEndian(bits, 4);
+}
+
+void MsgPackWriter::writeInteger(long long number) {
+    if (number >= 0) {
+        writeUnsigned((unsigned long long)number);
+        return;
+    }
+    beginValue();
+    if (number >= -32) {
+        buffer_ += (char)number;
+    } else if (number >= INT8_MIN) {
+        buffer_ += (char)0xd0;
+        bigEndian((unsigned long long)number, 1);
+    } else if (number >= INT16_MIN) {
+        buffer_ += (char)0xd1;
+        bigEndian((unsigned long long)number, 2);
+    } else if (number >= INT32_MIN) {
+        buffer_ += (char)0xd2;
+        bigEndian((unsigned long long)number, 4);
+    } else {
+        buffer_ += (char)0xd3;
+        bigEndian((unsigned long long)number, 8);
+    }
+}
+
+void MsgPackWriter::writeUnsigned(unsigned long long number) {
+    beginValue();
+    if (number < 0x80) {
+        buffer_ += (char)number;
+    } else if (number <= 0xff) {
+        buffer_ += (char)0xcc;
+        bigEndian(number, 1);
+    } else if (number <= 0xffff) {
+        buffer_ += (char)0xcd;
+        bigEndian(number, 2);
+    } else if (number <= 0xffffffffULL) {
+        buffer_ += (char)0xce;
+        bigEndian(number, 4);
+    } else {
+        buffer_ += (char)0xcf;
+        bigEndian(number, 8);
+    }
+}
+
+void MsgPackWriter::writeBool(bool flag) {
+    beginValue();
+    buffer_ += (char)(flag ? 0xc3 : 0xc2);
+}
+
+void MsgPackWriter::writeString(const char* text, size_t length) {
+    beginValue();
+    if (length < 32) {
+        buffer_ += (char)(0xa0 | length);
+    } else if (length <= 0xff) {
+        buffer_ += (char)0xd9;
+        bigEndian(length, 1);
+    } else if (length <= 0xffff) {
+        buffer_ += (char)0xda;
+        bigEndian(length, 2);
+    } else {
+        buffer_ += (char)0xdb;
+        bigEndian(length, 4);
+    }
+    buffer_.append(text, length);
+}
@@ -0,0 +1,46 @@
+#ifndef MSGPACK_WRITER_H
+#define MSGPACK_WRITER_H
+
+#include "result_writer.h"
+
+// MessagePack encoding of ResultWriter (https://msgpack.org/), for consumers
+// that would rather not parse text. The document has the same keys and
+// nesting as the JSON output, with two differences:
+//   - floats are float32 and doubles float64, so no precision is lost;
+//   - points() is a bin object holding count x 2 float32 (x, y) values in
+//     little endian order, which maps directly onto a Float32Array.
+// Framed records are prefixed with their size as a little endian uint32.
+class MsgPackWriter : public ResultWriter {
+public:
+    explicit MsgPackWriter(bool framed = false, size_t reserve = 4096);
+
+    MsgPackWriter& beginObject(size_t members);
+    MsgPackWriter& endObject();
+    MsgPackWriter& beginArray(size_t elements);
+    MsgPackWriter& endArray();
+    MsgPackWriter& key(const char* name);
+    MsgPackWriter& null();
+    MsgPackWriter& points(const float* xy, size_t count);
+    MsgPackWriter& endRecord();
+    void clear();
+
+protected:
+    void writeDouble(double number);
+    void writeFloat(float number);
+    void writeInteger(long long number);
+    void writeUnsigned(unsigned long long number);
+    void writeBool(bool flag);
+    void writeString(const char* text, size_t length);
+
+private:
+    void beginValue();
+    void header(unsigned char fix, unsigned char code16, size_t count);
+    void bigEndian(unsigned long long value, int bytes);
+
+    bool framed_;
+    // Nesting depth of open objects/arrays, and where the current record starts.
+    int depth_;
+    size_t recordStart_;
+};
+
+#endif
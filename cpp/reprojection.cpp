@@ -0,0 +1,159 @@
+#include "reprojection.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define REPROJECTION_X86 1
+#include <immintrin.h>
+#endif
+
+// Every kernel evaluates, per point:
+//   (xc, yc, zc) = R * (X, Y, Z) + t,  x = xc / zc,  y = yc / zc,  r2 = x^2 + y^2
+//   xd = x * (1 + k1 r2 + k2 r2^2 + k3 r2^3) + 2 p1 x y + p2 (r2 + 2 x^2)
+//   yd = y * (1 + k1 r2 + k2 r2^2 + k3 r2^3) + p1 (r2 + 2 y^2) + 2 p2 x y
+//   residual = (u, v) - (fx xd + cx, fy yd + cy)
+// which is cv::projectPoints for a zero-skew camera with 5 coefficients.
+// Squared errors are formed in float and summed in double.
+
+static double projectScalar(const ViewProjection& m, const ReprojectionPoints& p, size_t begin) {
+    double sum = 0;
+    for (size_t i = begin; i < p.count; i++) {
+        float X = p.X[i], Y = p.Y[i], Z = p.Z[i];
+        float xc = m.r[0] * X + m.r[1] * Y + m.r[2] * Z + m.t[0];
+        float yc = m.r[3] * X + m.r[4] * Y + m.r[5] * Z + m.t[1];
+        float zc = m.r[6] * X + m.r[7] * Y + m.r[8] * Z + m.t[2];
+        float iz = 1.0f / zc;
+        float x = xc * iz, y = yc * iz;
+        float x2 = x * x, y2 = y * y, xy = x * y, r2 = x2 + y2;
+        float radial = 1.0f + r2 * (m.k1 + r2 * (m.k2 + r2 * m.k3));
+        float xd = x * radial + 2.0f * m.p1 * xy + m.p2 * (r2 + 2.0f * x2);
+        float yd = y * radial + m.p1 * (r2 + 2.0f * y2) + 2.0f * m.p2 * xy;
+        float du = p.u[i] - (m.fx * xd + m.cx);
+        float dv = p.v[i] - (m.fy * yd + m.cy);
+        if (p.du) {
+            p.du[i] = du;
+            p.dv[i] = dv;
+        }
+        sum += (double)(du * du + dv * dv);
+    }
+    return sum;
+}
+
+static double reprojectScalar(const ViewProjection& m, const ReprojectionPoints& p) {
+    return projectScalar(m, p, 0);
+}
+
+#ifdef REPROJECTION_X86
+
+// 8 points per iteration; the remainder goes through the scalar loop.
+__attribute__((target("avx2,fma")))
+static double reprojectAvx2(const ViewProjection& m, const ReprojectionPoints& p) {
+    const __m256 r0 = _mm256_set1_ps(m.r[0]), r1 = _mm256_set1_ps(m.r[1]), r2 = _mm256_set1_ps(m.r[2]);
+    const __m256 r3 = _mm256_set1_ps(m.r[3]), r4 = _mm256_set1_ps(m.r[4]), r5 = _mm256_set1_ps(m.r[5]);
+    const __m256 r6 = _mm256_set1_ps(m.r[6]), r7 = _mm256_set1_ps(m.r[7]), r8 = _mm256_set1_ps(m.r[8]);
+    const __m256 t0 = _mm256_set1_ps(m.t[0]), t1 = _mm256_set1_ps(m.t[1]), t2 = _mm256_set1_ps(m.t[2]);
+    const __m256 k1 = _mm256_set1_ps(m.k1), k2 = _mm256_set1_ps(m.k2), k3 = _mm256_set1_ps(m.k3);
+    const __m256 p1 = _mm256_set1_ps(m.p1), p2 = _mm256_set1_ps(m.p2);
+    const __m256 fx = _mm256_set1_ps(m.fx), fy = _mm256_set1_ps(m.fy);
+    const __m256 cx = _mm256_set1_ps(m.cx), cy = _mm256_set1_ps(m.cy);
+    const __m256 one = _mm256_set1_ps(1.0f), two = _mm256_set1_ps(2.0f);
+    __m256d sumLow = _mm256_setzero_pd(), sumHigh = _mm256_setzero_pd();
+
+    size_t i = 0;
+    for (; i + 8 <= p.count; i += 8) {
+        __m256 X = _mm256_loadu_ps(p.X + i), Y = _mm256_loadu_ps(p.Y + i), Z = _mm256_loadu_ps(p.Z + i);
+        __m256 xc = _mm256_fmadd_ps(r0, X, _mm256_fmadd_ps(r1, Y, _mm256_fmadd_ps(r2, Z, t0)));
+        __m256 yc = _mm256_fmadd_ps(r3, X, _mm256_fmadd_ps(r4, Y, _mm256_fmadd_ps(r5, Z, t1)));
+        __m256 zc = _mm256_fmadd_ps(r6, X, _mm256_fmadd_ps(r7, Y, _mm256_fmadd_ps(r8, Z, t2)));
+        __m256 iz = _mm256_div_ps(one, zc);
+        __m256 x = _mm256_mul_ps(xc, iz), y = _mm256_mul_ps(yc, iz);
+        __m256 x2 = _mm256_mul_ps(x, x), y2 = _mm256_mul_ps(y, y), xy = _mm256_mul_ps(x, y);
+        __m256 rr = _mm256_add_ps(x2, y2);
+        __m256 radial = _mm256_fmadd_ps(rr, _mm256_fmadd_ps(rr, _mm256_fmadd_ps(rr, k3, k2), k1), one);
+        __m256 xd = _mm256_fmadd_ps(x, radial, _mm256_fmadd_ps(_mm256_mul_ps(two, p1), xy,
+                                                _mm256_mul_ps(p2, _mm256_fmadd_ps(two, x2, rr))));
+        __m256 yd = _mm256_fmadd_ps(y, radial, _mm256_fmadd_ps(p1, _mm256_fmadd_ps(two, y2, rr),
+                                                _mm256_mul_ps(_mm256_mul_ps(two, p2), xy)));
+        __m256 du = _mm256_sub_ps(_mm256_loadu_ps(p.u + i), _mm256_fmadd_ps(fx, xd, cx));
+        __m256 dv = _mm256_sub_ps(_mm256_loadu_ps(p.v + i), _mm256_fmadd_ps(fy, yd, cy));
+        if (p.du) {
+            _mm256_storeu_ps(p.du + i, du);
+            _mm256_storeu_ps(p.dv + i, dv);
+        }
+        __m256 e = _mm256_fmadd_ps(du, du, _mm256_mul_ps(dv, dv));
+        sumLow = _mm256_add_pd(sumLow, _mm256_cvtps_pd(_mm256_castps256_ps128(e)));
+        sumHigh = _mm256_add_pd(sumHigh, _mm256_cvtps_pd(_mm256_extractf128_ps(e, 1)));
+    }
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(sumLow, sumHigh));
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + projectScalar(m, p, i);
+}
+
+// 16 points per iteration; the remainder goes through the scalar loop.
+// GCC 12's AVX-512 headers trip -Wmaybe-uninitialized on _mm512_undefined_*.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#ifndef __clang__
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+__attribute__((target("avx512f")))
+static double reprojectAvx512(const ViewProjection& m, const ReprojectionPoints& p) {
+    const __m512 r0 = _mm512_set1_ps(m.r[0]), r1 = _mm512_set1_ps(m.r[1]), r2 = _mm512_set1_ps(m.r[2]);
+    const __m512 r3 = _mm512_set1_ps(m.r[3]), r4 = _mm512_set1_ps(m.r[4]), r5 = _mm512_set1_ps(m.r[5]);
+    const __m512 r6 = _mm512_set1_ps(m.r[6]), r7 = _mm512_set1_ps(m.r[7]), r8 = _mm512_set1_ps(m.r[8]);
+    const __m512 t0 = _mm512_set1_ps(m.t[0]), t1 = _mm512_set1_ps(m.t[1]), t2 = _mm512_set1_ps(m.t[2]);
+    const __m512 k1 = _mm512_set1_ps(m.k1), k2 = _mm512_set1_ps(m.k2), k3 = _mm512_set1_ps(m.k3);
+    const __m512 p1 = _mm512_set1_ps(m.p1), p2 = _mm512_set1_ps(m.p2);
+    const __m512 fx = _mm512_set1_ps(m.fx), fy = _mm512_set1_ps(m.fy);
+    const __m512 cx = _mm512_set1_ps(m.cx), cy = _mm512_set1_ps(m.cy);
+    const __m512 one = _mm512_set1_ps(1.0f), two = _mm512_set1_ps(2.0f);
+    __m512d sumLow = _mm512_setzero_pd(), sumHigh = _mm512_setzero_pd();
+
+    size_t i = 0;
+    for (; i + 16 <= p.count; i += 16) {
+        __m512 X = _mm512_loadu_ps(p.X + i), Y = _mm512_loadu_ps(p.Y + i), Z = _mm512_loadu_ps(p.Z + i);
+        __m512 xc = _mm512_fmadd_ps(r0, X, _mm512_fmadd_ps(r1, Y, _mm512_fmadd_ps(r2, Z, t0)));
+        __m512 yc = _mm512_fmadd_ps(r3, X, _mm512_fmadd_ps(r4, Y, _mm512_fmadd_ps(r5, Z, t1)));
+        __m512 zc = _mm512_fmadd_ps(r6, X, _mm512_fmadd_ps(r7, Y, _mm512_fmadd_ps(r8, Z, t2)));
+        __m512 iz = _mm512_div_ps(one, zc);
+        __m512 x = _mm512_mul_ps(xc, iz), y = _mm512_mul_ps(yc, iz);
+        __m512 x2 = _mm512_mul_ps(x, x), y2 = _mm512_mul_ps(y, y), xy = _mm512_mul_ps(x, y);
+        __m512 rr = _mm512_add_ps(x2, y2);
+        __m512 radial = _mm512_fmadd_ps(rr, _mm512_fmadd_ps(rr, _mm512_fmadd_ps(rr, k3, k2), k1), one);
+        __m512 xd = _mm512_fmadd_ps(x, radial, _mm512_fmadd_ps(_mm512_mul_ps(two, p1), xy,
+                                                _mm512_mul_ps(p2, _mm512_fmadd_ps(two, x2, rr))));
+        __m512 yd = _mm512_fmadd_ps(y, radial, _mm512_fmadd_ps(p1, _mm512_fmadd_ps(two, y2, rr),
+                                                _mm512_mul_ps(_mm512_mul_ps(two, p2), xy)));
+        __m512 du = _mm512_sub_ps(_mm512_loadu_ps(p.u + i), _mm512_fmadd_ps(fx, xd, cx));
+        __m512 dv = _mm512_sub_ps(_mm512_loadu_ps(p.v + i), _mm512_fmadd_ps(fy, yd, cy));
+        if (p.du) {
+            _mm512_storeu_ps(p.du + i, du);
+            _mm512_storeu_ps(p.dv + i, dv);
+        }
+        __m512 e = _mm512_fmadd_ps(du, du, _mm512_mul_ps(dv, dv));
+        __m256 high = _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(e), 1));
+        sumLow = _mm512_add_pd(sumLow, _mm512_cvtps_pd(_mm512_castps512_ps256(e)));
+        sumHigh = _mm512_add_pd(sumHigh, _mm512_cvtps_pd(high));
+    }
+
+    return _mm512_reduce_add_pd(_mm512_add_pd(sumLow, sumHigh)) + projectScalar(m, p, i);
+}
+#pragma GCC diagnostic pop
+
+#endif
+
+typedef double (*ReprojectionKernel)(const ViewProjection&, const ReprojectionPoints&);
+
+static ReprojectionKernel chooseKernel() {
+#ifdef REPROJECTION_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return reprojectAvx512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return reprojectAvx2;
+#endif
+    return reprojectScalar;
+}
+
+double reprojectionSquaredError(const ViewProjection& view, const ReprojectionPoints& points) {
+    // Resolved once, on first use.
+    static const ReprojectionKernel kernel = chooseKernel();
+    return kernel(view, points);
+}
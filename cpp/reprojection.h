@@ -0,0 +1,39 @@
+#ifndef REPROJECTION_H
+#define REPROJECTION_H
+
+#include <stddef.h>
+
+// Fast reprojection for error reporting: projects board points through a
+// pinhole camera with the default 5-coefficient distortion model (k1, k2,
+// p1, p2, k3) and compares them with the observed corners, without the
+// Jacobian machinery of cv::projectPoints. Works on plain float arrays in
+// structure-of-arrays layout, so it has no OpenCV dependency; on x86 the
+// AVX2 or AVX-512 variant is picked at run time, with a scalar fallback.
+
+// Intrinsics, distortion and pose of one view. `r` is the row-major rotation
+// matrix (see cv::Rodrigues) and `t` the translation.
+struct ViewProjection {
+    float fx, fy, cx, cy;
+    float k1, k2, p1, p2, k3;
+    float r[9];
+    float t[3];
+};
+
+// Points of one view, one array per coordinate. `du`/`dv` receive the
+// residuals (observed - reprojected) and may be NULL when not needed.
+struct ReprojectionPoints {
+    const float* X;
+    const float* Y;
+    const float* Z;
+    const float* u;
+    const float* v;
+    float* du;
+    float* dv;
+    size_t count;
+};
+
+// Sum of squared reprojection errors over the points, in pixels^2. For a
+// given machine the result is deterministic; it is accumulated in double.
+double reprojectionSquaredError(const ViewProjection& view, const ReprojectionPoints& points);
+
+#endif
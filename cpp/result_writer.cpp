@@ -0,0 +1,47 @@
+#include "result_writer.h"
+#include "json_writer.h"
+#include "msgpack_writer.h"
+
+#include <cerrno>
+#include <cstring>
+
+bool parseOutputFormat(const std::string& name, OutputFormat& format) {
+    if (name == "json") {
+        format = OUTPUT_JSON;
+        return true;
+    }
+    if (name == "msgpack") {
+        format = OUTPUT_MSGPACK;
+        return true;
+    }
+    return false;
+}
+
+ResultWriter& ResultWriter::value(const char* text) {
+    writeString(text, strlen(text));
+    return *this;
+}
+
+bool ResultWriter::flush(int fd) {
+    bool ok = writeFully(fd, buffer_.data(), buffer_.size());
+    clear();
+    return ok;
+}
+
+ResultWriter* createResultWriter(OutputFormat format, bool framed, size_t reserve) {
+    if (format == OUTPUT_MSGPACK) return new MsgPackWriter(framed, reserve);
+    return new JsonWriter(reserve);
+}
+
+bool writeFully(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        size -= (size_t)written;
+    }
+    return true;
+}
@@ -0,0 +1,94 @@
+#ifndef RESULT_WRITER_H
+#define RESULT_WRITER_H
+
+#include <string>
+#include <unistd.h>
+
+// Output formats understood by both tools (--output=json|msgpack).
+enum OutputFormat {
+    OUTPUT_JSON,
+    OUTPUT_MSGPACK
+};
+
+// Parse an --output=<format> value; returns false for unknown formats.
+bool parseOutputFormat(const std::string& name, OutputFormat& format);
+
+// Serializer for tool results, shared by detect_corners and calibrate_camera.
+//
+// A result is described as a tree of objects, arrays and scalars; the
+// concrete writer decides the encoding (JsonWriter, MsgPackWriter). Objects
+// and arrays are opened with their final member/element count, which binary
+// formats need up front and text formats ignore:
+//
+//     out.beginObject(2);
+//     out.key("rms").value(rms);
+//     out.key("corners").points(&corners[0].x, corners.size());
+//     out.endObject();
+//     out.endRecord();
+//     out.flush();
+//
+// Everything is appended to one growing buffer that is handed to the kernel
+// with a single write() once the record is complete.
+class ResultWriter {
+public:
+    explicit ResultWriter(size_t reserve) { buffer_.reserve(reserve); }
+    virtual ~ResultWriter() {}
+
+    virtual ResultWriter& beginObject(size_t members) = 0;
+    virtual ResultWriter& endObject() = 0;
+    virtual ResultWriter& beginArray(size_t elements) = 0;
+    virtual ResultWriter& endArray() = 0;
+
+    // Start an object member; the next value written belongs to it.
+    virtual ResultWriter& key(const char* name) = 0;
+
+    ResultWriter& value(double number) { writeDouble(number); return *this; }
+    ResultWriter& value(float number) { writeFloat(number); return *this; }
+    ResultWriter& value(int number) { writeInteger(number); return *this; }
+    ResultWriter& value(long number) { writeInteger(number); return *this; }
+    ResultWriter& value(long long number) { writeInteger(number); return *this; }
+    ResultWriter& value(unsigned int number) { writeUnsigned(number); return *this; }
+    ResultWriter& value(unsigned long number) { writeUnsigned(number); return *this; }
+    ResultWriter& value(unsigned long long number) { writeUnsigned(number); return *this; }
+    ResultWriter& value(bool flag) { writeBool(flag); return *this; }
+    ResultWriter& value(const char* text);
+    ResultWriter& value(const std::string& text) { writeString(text.data(), text.size()); return *this; }
+    virtual ResultWriter& null() = 0;
+
+    // A list of `count` 2D points stored as interleaved x, y floats.
+    virtual ResultWriter& points(const float* xy, size_t count) = 0;
+
+    // Terminate a top-level record, framing it for streaming modes.
+    virtual ResultWriter& endRecord() = 0;
+
+    const char* data() const { return buffer_.data(); }
+    size_t size() const { return buffer_.size(); }
+    const std::string& str() const { return buffer_; }
+
+    // Drop the contents but keep the allocation for the next record.
+    virtual void clear() { buffer_.clear(); }
+
+    // Write everything buffered so far to `fd` and clear the writer.
+    bool flush(int fd = STDOUT_FILENO);
+
+protected:
+    virtual void writeDouble(double number) = 0;
+    virtual void writeFloat(float number) = 0;
+    virtual void writeInteger(long long number) = 0;
+    virtual void writeUnsigned(unsigned long long number) = 0;
+    virtual void writeBool(bool flag) = 0;
+    virtual void writeString(const char* text, size_t length) = 0;
+
+    std::string buffer_;
+};
+
+// Create a writer for `format`. Framed writers delimit every record so that
+// several can be streamed back to back (server and batch modes): JSON ends
+// each record with a newline either way, MessagePack records get a 4-byte
+// little endian length prefix.
+ResultWriter* createResultWriter(OutputFormat format, bool framed, size_t reserve = 4096);
+
+// write() all of `data`, retrying short writes and EINTR.
+bool writeFully(int fd, const char* data, size_t size);
+
+#endif